@@ -42,6 +42,9 @@ void AurClient::Search(const std::vector<std::string>& names,
   SearchRequest request;
   request.set_search_by(call_options.search_by);
   request.set_search_logic(call_options.search_logic);
+  request.set_order_by(call_options.order_by);
+  request.set_page_size(call_options.page_size);
+  request.set_page_token(call_options.page_token);
   if (call_options.field_mask.paths_size() > 0) {
     *request.mutable_options()->mutable_package_field_mask() =
         call_options.field_mask;
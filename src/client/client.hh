@@ -20,6 +20,9 @@ class AurClient final {
     SearchRequest::SearchBy search_by = SearchRequest::SEARCHBY_UNKNOWN;
     SearchRequest::SearchLogic search_logic =
         SearchRequest::SEARCHLOGIC_UNKNOWN;
+    SearchRequest::OrderBy order_by = SearchRequest::ORDERBY_UNKNOWN;
+    int page_size = 0;
+    std::string page_token;
 
     LookupRequest::LookupBy lookup_by = LookupRequest::LOOKUPBY_UNKNOWN;
 
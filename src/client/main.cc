@@ -23,8 +23,13 @@ namespace {
       "  -l LOOKUP_BY       lookup by the given field (name, pkgbase, maintainer,\n"
       "                         group, keyword, depends, makedepends, checkdepends,\n"
       "                         optdepends)\n"
-      "  -s SEARCH_BY       search by given corpus (name, name_desc)\n"
+      "  -s SEARCH_BY       search by given corpus (name, name_desc, words,\n"
+      "                         name_fuzzy)\n"
       "  -o LOGIC           search using given set logic (disjunctive, conjunctive)\n"
+      "  -r ORDER_BY        order search results by (relevance, name, votes,\n"
+      "                         popularity, modified)\n"
+      "  -n PAGE_SIZE       return at most this many search results\n"
+      "  -p PAGE_TOKEN      continue a search from an earlier page\n"
       "\n");
   // clang-format on
   exit(0);
@@ -50,7 +55,7 @@ int main(int argc, char** argv) {
   aur::v1::AurClient::CallOptions call_options;
 
   int opt;
-  while ((opt = getopt(argc, argv, "a:l:m:ho:s:")) != -1) {
+  while ((opt = getopt(argc, argv, "a:l:m:hn:o:p:r:s:")) != -1) {
     switch (opt) {
       case 'a':
         server_address = optarg;
@@ -68,6 +73,9 @@ int main(int argc, char** argv) {
         google::protobuf::util::FieldMaskUtil::FromString(
             optarg, &call_options.field_mask);
         break;
+      case 'n':
+        call_options.page_size = atoi(optarg);
+        break;
       case 'o':
         if (!aur::v1::SearchRequest::SearchLogic_Parse(
                 MakeEnumName("SEARCHLOGIC_", optarg),
@@ -76,6 +84,16 @@ int main(int argc, char** argv) {
           return 1;
         }
         break;
+      case 'p':
+        call_options.page_token = optarg;
+        break;
+      case 'r':
+        if (!aur::v1::SearchRequest::OrderBy_Parse(
+                MakeEnumName("ORDERBY_", optarg), &call_options.order_by)) {
+          std::cerr << "error: invalid order by: " << optarg << '\n';
+          return 1;
+        }
+        break;
       case 's':
         if (!aur::v1::SearchRequest::SearchBy_Parse(
                 MakeEnumName("SEARCHBY_", optarg), &call_options.search_by)) {
@@ -1,30 +1,59 @@
 #include <getopt.h>
 
+#include <filesystem>
 #include <iostream>
 
 #include "server/server.hh"
+#include "storage/storage.hh"
 
 [[noreturn]] void usage() {
-  std::cout << program_invocation_short_name << "[-l listen_address]\n";
+  std::cout << program_invocation_short_name
+            << "[-l listen_address] [-d dbpath] [-j load_threads] [-w]\n";
   exit(0);
 }
 
 int main(int argc, char** argv) {
   const char* listen_address = "127.0.0.1:9000";
+  const char* dbpath = "db.packed";
+  aur_internal::ServiceImpl::Options service_options;
+  bool watch = false;
 
   int opt;
-  while ((opt = getopt(argc, argv, "hl:")) != -1) {
+  while ((opt = getopt(argc, argv, "d:hj:l:w")) != -1) {
     switch (opt) {
+      case 'd':
+        dbpath = optarg;
+        break;
       case 'h':
         usage();
+      case 'j':
+        service_options.load_threads = atoi(optarg);
+        break;
       case 'l':
         listen_address = optarg;
         break;
+      case 'w':
+        watch = true;
+        break;
       case '?':
         exit(1);
     }
   }
 
-  aur::Server(listen_address).Run();
+  aur::Server server(listen_address, aur_storage::OpenStorage(dbpath),
+                     std::move(service_options));
+
+  if (watch) {
+    // A packed database is replaced by renaming over it, so we need to watch
+    // the directory that contains it.
+    const std::filesystem::path path = std::filesystem::absolute(dbpath);
+    if (std::filesystem::is_regular_file(path)) {
+      server.WatchStorage(path.parent_path(), path.filename());
+    } else {
+      server.WatchStorage(path, "");
+    }
+  }
+
+  server.Run();
   return 0;
 }
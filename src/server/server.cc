@@ -1,13 +1,32 @@
 #include "server/server.hh"
 
+#include <string.h>
+#include <sys/inotify.h>
+
+#include <algorithm>
 #include <iostream>
 
 #include "grpcpp/ext/proto_server_reflection_plugin.h"
 
 namespace aur {
 
-Server::Server(const std::string& listen_address)
-    : listen_address_(listen_address) {
+namespace {
+
+// A reload is triggered once no changes have been seen for this long...
+constexpr uint64_t kReloadSettleUsec = 2 * 1000 * 1000;
+
+// ...but never later than this long after the first change, so that a steady
+// trickle of writes can't postpone a reload indefinitely.
+constexpr uint64_t kReloadMaxDelayUsec = 30 * 1000 * 1000;
+
+}  // namespace
+
+Server::Server(const std::string& listen_address,
+               std::unique_ptr<aur_storage::Storage> storage,
+               aur_internal::ServiceImpl::Options service_options)
+    : listen_address_(listen_address),
+      storage_(std::move(storage)),
+      service_impl_(storage_.get(), std::move(service_options)) {
   grpc::reflection::InitProtoReflectionServerBuilderPlugin();
   builder_.AddListeningPort(listen_address_, grpc::InsecureServerCredentials());
   builder_.RegisterService(&aur_service_v1_);
@@ -17,9 +36,16 @@ Server::~Server() {
   for (auto* signal_event : signal_events_) {
     sd_event_source_unref(signal_event);
   }
+  sd_event_source_unref(inotify_event_);
+  sd_event_source_unref(reload_timer_);
   sd_event_unref(event_);
 }
 
+void Server::WatchStorage(std::string path, std::string filename) {
+  watch_path_ = std::move(path);
+  watch_filename_ = std::move(filename);
+}
+
 void Server::Run() {
   sigset_t ss{};
   sigaddset(&ss, SIGHUP);
@@ -36,6 +62,17 @@ void Server::Run() {
   sd_event_add_signal(event_, &signal_events_.emplace_back(), SIGHUP,
                       &Server::HandleSignal, this);
 
+  if (!watch_path_.empty()) {
+    int r = sd_event_add_inotify(
+        event_, &inotify_event_, watch_path_.c_str(),
+        IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE,
+        &Server::HandleInotify, this);
+    if (r < 0) {
+      std::cerr << "error: failed to watch " << watch_path_ << ": "
+                << strerror(-r) << '\n';
+    }
+  }
+
   server_ = builder_.BuildAndStart();
   std::cout << "ready to serve on " << listen_address_ << '\n';
 
@@ -62,4 +99,51 @@ int Server::HandleSignal(sd_event_source*, const struct signalfd_siginfo* si,
   return 0;
 }
 
+// static
+int Server::HandleInotify(sd_event_source*, const struct inotify_event* ev,
+                          void* userdata) {
+  auto server = static_cast<Server*>(userdata);
+
+  // An overflow means we've lost track of what changed, which is as good a
+  // reason as any to reload.
+  if ((ev->mask & IN_Q_OVERFLOW) == 0 && !server->watch_filename_.empty() &&
+      (ev->len == 0 || server->watch_filename_ != ev->name)) {
+    return 0;
+  }
+
+  server->ScheduleReload();
+  return 0;
+}
+
+void Server::ScheduleReload() {
+  uint64_t now;
+  sd_event_now(event_, CLOCK_MONOTONIC, &now);
+
+  if (first_change_usec_ == 0) {
+    first_change_usec_ = now;
+  }
+
+  const uint64_t deadline = std::min(now + kReloadSettleUsec,
+                                     first_change_usec_ + kReloadMaxDelayUsec);
+
+  if (reload_timer_ == nullptr) {
+    sd_event_add_time(event_, &reload_timer_, CLOCK_MONOTONIC, deadline, 0,
+                      &Server::HandleReloadTimer, this);
+  } else {
+    sd_event_source_set_time(reload_timer_, deadline);
+    sd_event_source_set_enabled(reload_timer_, SD_EVENT_ONESHOT);
+  }
+}
+
+// static
+int Server::HandleReloadTimer(sd_event_source*, uint64_t, void* userdata) {
+  auto server = static_cast<Server*>(userdata);
+
+  std::cout << "storage changed, reloading...\n";
+  server->first_change_usec_ = 0;
+  server->service_impl_.Reload();
+
+  return 0;
+}
+
 }  // namespace aur
@@ -7,31 +7,54 @@
 #include "grpcpp/grpcpp.h"
 #include "service/internal/service_impl.hh"
 #include "service/v1/service.hh"
-#include "storage/filesystem_storage.hh"
+#include "storage/storage.hh"
 
 namespace aur {
 
 class Server {
  public:
-  Server(const std::string& listen_address);
+  Server(const std::string& listen_address,
+         std::unique_ptr<aur_storage::Storage> storage,
+         aur_internal::ServiceImpl::Options service_options);
   ~Server();
 
+  // Watches the directory at |path| for changes once the server is running,
+  // and reloads the service after a burst of changes settles. If |filename|
+  // is non-empty, only changes to that entry of the directory are considered.
+  // Must be called before Run().
+  void WatchStorage(std::string path, std::string filename);
+
   void Run();
 
  private:
   static int HandleSignal(sd_event_source* s, const struct signalfd_siginfo* si,
                           void* userdata);
+  static int HandleInotify(sd_event_source* s, const struct inotify_event* ev,
+                           void* userdata);
+  static int HandleReloadTimer(sd_event_source* s, uint64_t usec,
+                               void* userdata);
+
+  void ScheduleReload();
 
   std::string listen_address_;
-  aur_storage::FilesystemStorage storage_{"db"};
-  aur_internal::ServiceImpl service_impl_{&storage_};
+  std::unique_ptr<aur_storage::Storage> storage_;
+  aur_internal::ServiceImpl service_impl_;
   aur::v1::AurService aur_service_v1_{&service_impl_};
 
   grpc::ServerBuilder builder_;
   std::unique_ptr<grpc::Server> server_;
 
-  sd_event* event_;
+  std::string watch_path_;
+  std::string watch_filename_;
+
+  sd_event* event_ = nullptr;
   std::vector<sd_event_source*> signal_events_;
+  sd_event_source* inotify_event_ = nullptr;
+  sd_event_source* reload_timer_ = nullptr;
+
+  // Monotonic time of the first change in the current burst, or zero if no
+  // reload is pending.
+  uint64_t first_change_usec_ = 0;
 };
 
 };  // namespace aur
@@ -0,0 +1,84 @@
+#include "service/internal/aho_corasick.hh"
+
+#include <deque>
+
+namespace aur_internal {
+
+AhoCorasick::AhoCorasick(const std::vector<std::string>& patterns) {
+  // Class 0 is every byte that appears in no pattern.
+  for (const std::string& pattern : patterns) {
+    for (char c : pattern) {
+      uint16_t& cls = classes_[static_cast<unsigned char>(c)];
+      if (cls == 0) {
+        cls = num_classes_++;
+      }
+    }
+  }
+
+  // The trie of patterns, with missing transitions marked as kNone.
+  constexpr uint32_t kNone = ~uint32_t{0};
+  transitions_.assign(num_classes_, kNone);
+  std::vector<std::vector<uint32_t>> outputs(1);
+  for (uint32_t id = 0; id < patterns.size(); ++id) {
+    const std::string& pattern = patterns[id];
+    if (pattern.empty()) {
+      continue;
+    }
+
+    uint32_t state = 0;
+    for (char c : pattern) {
+      const size_t slot =
+          state * num_classes_ + classes_[static_cast<unsigned char>(c)];
+      if (transitions_[slot] == kNone) {
+        transitions_[slot] = outputs.size();
+        transitions_.resize(transitions_.size() + num_classes_, kNone);
+        outputs.emplace_back();
+      }
+      state = transitions_[slot];
+    }
+    outputs[state].push_back(id);
+  }
+
+  // Resolve the missing transitions through the failure links, visiting
+  // states breadth first so that every state's failure state, which is
+  // shallower, is complete by the time it's needed.
+  std::vector<uint32_t> failure(outputs.size(), 0);
+  std::deque<uint32_t> queue;
+  for (uint32_t c = 0; c < num_classes_; ++c) {
+    uint32_t& next = transitions_[c];
+    if (next == kNone) {
+      next = 0;
+    } else {
+      queue.push_back(next);
+    }
+  }
+
+  while (!queue.empty()) {
+    const uint32_t state = queue.front();
+    queue.pop_front();
+
+    for (uint32_t c = 0; c < num_classes_; ++c) {
+      const uint32_t fallback = transitions_[failure[state] * num_classes_ + c];
+      uint32_t& next = transitions_[state * num_classes_ + c];
+      if (next == kNone) {
+        next = fallback;
+        continue;
+      }
+
+      failure[next] = fallback;
+      outputs[next].insert(outputs[next].end(), outputs[fallback].begin(),
+                           outputs[fallback].end());
+      queue.push_back(next);
+    }
+  }
+
+  output_offsets_.reserve(outputs.size() + 1);
+  output_offsets_.push_back(0);
+  for (const auto& state_outputs : outputs) {
+    outputs_.insert(outputs_.end(), state_outputs.begin(),
+                    state_outputs.end());
+    output_offsets_.push_back(outputs_.size());
+  }
+}
+
+}  // namespace aur_internal
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace aur_internal {
+
+// AhoCorasick finds every occurrence of a fixed set of byte strings in a text
+// with a single pass over the text, no matter how many strings there are.
+//
+// The automaton is fully resolved into a transition table, so that scanning
+// costs a table lookup per byte of text. Bytes are first mapped to classes,
+// with every byte that appears in none of the patterns sharing one class, to
+// keep the table small.
+class AhoCorasick final {
+ public:
+  AhoCorasick() = default;
+
+  // Builds an automaton for |patterns|, which are identified by their index.
+  // Empty patterns are ignored.
+  explicit AhoCorasick(const std::vector<std::string>& patterns);
+
+  AhoCorasick(AhoCorasick&&) = default;
+  AhoCorasick& operator=(AhoCorasick&&) = default;
+
+  AhoCorasick(const AhoCorasick&) = default;
+  AhoCorasick& operator=(const AhoCorasick&) = default;
+
+  // Calls on_match(pattern, end) for each occurrence of a pattern in |text|,
+  // in order of the position |end| just past the occurrence. Scanning stops
+  // early if on_match returns true, and Scan() then returns true.
+  template <typename Fn>
+  bool Scan(std::string_view text, const Fn& on_match) const {
+    if (outputs_.empty()) {
+      return false;
+    }
+
+    uint32_t state = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+      const uint32_t c = classes_[static_cast<unsigned char>(text[i])];
+      state = transitions_[state * num_classes_ + c];
+      for (uint32_t j = output_offsets_[state];
+           j < output_offsets_[state + 1]; ++j) {
+        if (on_match(outputs_[j], i + 1)) {
+          return true;
+        }
+      }
+    }
+
+    return false;
+  }
+
+ private:
+  uint16_t classes_[256] = {};
+  uint32_t num_classes_ = 1;
+
+  // The state following state s on a byte of class c is
+  // transitions_[s * num_classes_ + c]. State 0 is the start.
+  std::vector<uint32_t> transitions_;
+
+  // Patterns ending at state s, including those ending at any of its proper
+  // suffixes, are outputs_[output_offsets_[s]] up to
+  // outputs_[output_offsets_[s + 1]].
+  std::vector<uint32_t> output_offsets_;
+  std::vector<uint32_t> outputs_;
+};
+
+}  // namespace aur_internal
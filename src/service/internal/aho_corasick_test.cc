@@ -0,0 +1,95 @@
+#include "service/internal/aho_corasick.hh"
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using aur_internal::AhoCorasick;
+using testing::ElementsAre;
+using testing::IsEmpty;
+
+namespace {
+
+using Match = std::pair<uint32_t, size_t>;
+
+std::vector<Match> ScanAll(const AhoCorasick& automaton,
+                           const std::string& text) {
+  std::vector<Match> matches;
+  automaton.Scan(text, [&](uint32_t id, size_t end) {
+    matches.emplace_back(id, end);
+    return false;
+  });
+  return matches;
+}
+
+TEST(AhoCorasickTest, FindsOverlappingMatches) {
+  const AhoCorasick automaton({"he", "she", "his", "hers", ""});
+
+  EXPECT_THAT(ScanAll(automaton, "ushers"),
+              ElementsAre(Match(1, 4), Match(0, 4), Match(3, 6)));
+  EXPECT_THAT(ScanAll(automaton, "xyz"), IsEmpty());
+  EXPECT_THAT(ScanAll(automaton, ""), IsEmpty());
+  EXPECT_THAT(ScanAll(AhoCorasick(), "ushers"), IsEmpty());
+}
+
+TEST(AhoCorasickTest, StopsEarly) {
+  const AhoCorasick automaton({"a"});
+
+  int calls = 0;
+  EXPECT_TRUE(automaton.Scan("banana", [&](uint32_t, size_t end) {
+    ++calls;
+    return end == 4;
+  }));
+  EXPECT_EQ(calls, 2);
+
+  EXPECT_FALSE(automaton.Scan("xyz", [](uint32_t, size_t) { return true; }));
+}
+
+TEST(AhoCorasickTest, AgreesWithFind) {
+  std::mt19937 rng(20201017);
+  auto random_string = [&](size_t min_size, size_t max_size) {
+    std::string s(min_size + rng() % (max_size - min_size + 1), '\0');
+    for (char& c : s) {
+      c = "ab\xff"[rng() % 3];
+    }
+    return s;
+  };
+
+  for (int i = 0; i < 200; ++i) {
+    std::vector<std::string> patterns;
+    for (int j = 0; j < 1 + i % 8; ++j) {
+      patterns.push_back(random_string(1, 4));
+    }
+    const AhoCorasick automaton(patterns);
+
+    for (int j = 0; j < 20; ++j) {
+      const std::string text = random_string(0, 16);
+
+      std::vector<Match> expected;
+      for (size_t end = 1; end <= text.size(); ++end) {
+        for (uint32_t id = 0; id < patterns.size(); ++id) {
+          const std::string& p = patterns[id];
+          if (p.size() <= end &&
+              text.compare(end - p.size(), p.size(), p) == 0) {
+            expected.emplace_back(id, end);
+          }
+        }
+      }
+
+      auto matches = ScanAll(automaton, text);
+      std::sort(matches.begin(), matches.end(),
+                [](const Match& a, const Match& b) {
+                  return a.second != b.second ? a.second < b.second
+                                              : a.first < b.first;
+                });
+      ASSERT_EQ(matches, expected) << "text: " << text;
+    }
+  }
+}
+
+}  // namespace
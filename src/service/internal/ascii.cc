@@ -0,0 +1,113 @@
+#include "service/internal/ascii.hh"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace aur_internal {
+
+namespace {
+
+#ifdef __SSE2__
+__m128i Load(const char* p) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+// Lowercases the bytes of |chunk| which are in A-Z. The comparisons are
+// signed, so bytes at or above 0x80 compare below 'A' and are left alone.
+__m128i ToLower(__m128i chunk) {
+  const __m128i before_upper = _mm_set1_epi8('A' - 1);
+  const __m128i after_upper = _mm_set1_epi8('Z' + 1);
+  const __m128i case_bit = _mm_set1_epi8('a' - 'A');
+  const __m128i is_upper = _mm_and_si128(_mm_cmpgt_epi8(chunk, before_upper),
+                                         _mm_cmplt_epi8(chunk, after_upper));
+  return _mm_or_si128(chunk, _mm_and_si128(is_upper, case_bit));
+}
+#endif
+
+}  // namespace
+
+void AsciiToLower(const char* in, size_t size, char* out) {
+  size_t i = 0;
+
+#ifdef __SSE2__
+  for (; i + sizeof(__m128i) <= size; i += sizeof(__m128i)) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+                     ToLower(Load(in + i)));
+  }
+#endif
+
+  for (; i < size; ++i) {
+    out[i] = AsciiToLower(in[i]);
+  }
+}
+
+bool AsciiEqualsIgnoreCase(std::string_view subject, std::string_view lowered) {
+  if (subject.size() != lowered.size()) {
+    return false;
+  }
+
+  size_t i = 0;
+
+#ifdef __SSE2__
+  for (; i + sizeof(__m128i) <= subject.size(); i += sizeof(__m128i)) {
+    const __m128i eq = _mm_cmpeq_epi8(ToLower(Load(subject.data() + i)),
+                                      Load(lowered.data() + i));
+    if (_mm_movemask_epi8(eq) != 0xffff) {
+      return false;
+    }
+  }
+#endif
+
+  for (; i < subject.size(); ++i) {
+    if (AsciiToLower(subject[i]) != lowered[i]) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+size_t AsciiFindIgnoreCase(std::string_view subject, std::string_view lowered) {
+  if (lowered.empty()) {
+    return 0;
+  }
+  if (lowered.size() > subject.size()) {
+    return subject.npos;
+  }
+
+  const size_t last = lowered.size() - 1;
+  size_t i = 0;
+
+#ifdef __SSE2__
+  // Compare the first and last bytes of the needle against 16 candidate
+  // positions at once, and only compare the rest at positions where both
+  // match.
+  const __m128i first_byte = _mm_set1_epi8(lowered[0]);
+  const __m128i last_byte = _mm_set1_epi8(lowered[last]);
+  for (; i + last + sizeof(__m128i) <= subject.size(); i += sizeof(__m128i)) {
+    const __m128i first_eq =
+        _mm_cmpeq_epi8(ToLower(Load(subject.data() + i)), first_byte);
+    const __m128i last_eq =
+        _mm_cmpeq_epi8(ToLower(Load(subject.data() + i + last)), last_byte);
+    for (unsigned mask = _mm_movemask_epi8(_mm_and_si128(first_eq, last_eq));
+         mask != 0; mask &= mask - 1) {
+      const size_t pos = i + __builtin_ctz(mask);
+      if (AsciiEqualsIgnoreCase(subject.substr(pos + 1, last),
+                                lowered.substr(1))) {
+        return pos;
+      }
+    }
+  }
+#endif
+
+  for (; i + last < subject.size(); ++i) {
+    if (AsciiEqualsIgnoreCase(subject.substr(i, lowered.size()), lowered)) {
+      return i;
+    }
+  }
+
+  return subject.npos;
+}
+
+}  // namespace aur_internal
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace aur_internal {
+
+inline char AsciiToLower(char c) {
+  return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+// Writes the ASCII lowercase form of the |size| bytes at |in| to |out|, which
+// may be the same as |in|. Bytes outside of A-Z are copied unchanged.
+void AsciiToLower(const char* in, size_t size, char* out);
+
+// Returns true if |subject| equals |lowered| when ASCII case is ignored.
+// |lowered| must already be lowercase.
+bool AsciiEqualsIgnoreCase(std::string_view subject, std::string_view lowered);
+
+// Returns the position of the first occurrence of |lowered| in |subject| when
+// ASCII case is ignored, or std::string_view::npos if there is none.
+// |lowered| must already be lowercase.
+size_t AsciiFindIgnoreCase(std::string_view subject, std::string_view lowered);
+
+// A lowercased copy of a string, held on the stack unless the string is
+// unusually long. Lookups fold their keys through this so that probing an
+// index doesn't need to allocate.
+class LowercasedKey final {
+ public:
+  explicit LowercasedKey(std::string_view key) {
+    char* out = inline_;
+    if (key.size() > sizeof(inline_)) {
+      heap_.resize(key.size());
+      out = heap_.data();
+    }
+    AsciiToLower(key.data(), key.size(), out);
+    view_ = std::string_view(out, key.size());
+  }
+
+  LowercasedKey(LowercasedKey&&) = delete;
+  LowercasedKey& operator=(LowercasedKey&&) = delete;
+
+  LowercasedKey(const LowercasedKey&) = delete;
+  LowercasedKey& operator=(const LowercasedKey&) = delete;
+
+  std::string_view view() const { return view_; }
+
+ private:
+  char inline_[256];
+  std::string heap_;
+  std::string_view view_;
+};
+
+}  // namespace aur_internal
@@ -0,0 +1,48 @@
+#include "service/internal/ascii.hh"
+
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using aur_internal::AsciiToLower;
+using aur_internal::LowercasedKey;
+
+namespace {
+
+TEST(AsciiTest, ToLower) {
+  // Long enough to cover both the vectorized and the scalar paths, with every
+  // byte value represented.
+  std::string input;
+  for (int i = 0; i < 3; ++i) {
+    for (int c = 0; c < 256; ++c) {
+      input.push_back(static_cast<char>(c));
+    }
+  }
+  input.append("@AZ[`az{");
+
+  std::string output(input.size(), '\0');
+  AsciiToLower(input.data(), input.size(), output.data());
+
+  for (size_t i = 0; i < input.size(); ++i) {
+    const char c = input[i];
+    const char expected = c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+    EXPECT_EQ(output[i], expected) << "at offset " << i;
+  }
+}
+
+TEST(AsciiTest, ToLowerInPlace) {
+  std::string s = "Hello, World! THIS IS A LONGER STRING.";
+  AsciiToLower(s.data(), s.size(), s.data());
+  EXPECT_EQ(s, "hello, world! this is a longer string.");
+}
+
+TEST(AsciiTest, LowercasedKey) {
+  EXPECT_EQ(LowercasedKey("").view(), "");
+  EXPECT_EQ(LowercasedKey("PkgFile").view(), "pkgfile");
+
+  const std::string long_key(1000, 'Q');
+  EXPECT_EQ(LowercasedKey(long_key).view(), std::string(1000, 'q'));
+}
+
+}  // namespace
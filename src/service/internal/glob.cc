@@ -0,0 +1,263 @@
+#include "service/internal/glob.hh"
+
+#include <fnmatch.h>
+
+#include <algorithm>
+
+#include "service/internal/ascii.hh"
+
+namespace aur_internal {
+
+namespace {
+
+// Literal comparisons against lowercased pattern text, which reduce to plain
+// byte comparisons when the subject is lowercase too.
+template <bool kLowercase>
+bool LiteralEquals(std::string_view subject, std::string_view lowered) {
+  if constexpr (kLowercase) {
+    return subject == lowered;
+  } else {
+    return AsciiEqualsIgnoreCase(subject, lowered);
+  }
+}
+
+template <bool kLowercase>
+size_t LiteralFind(std::string_view subject, std::string_view lowered) {
+  if constexpr (kLowercase) {
+    return subject.find(lowered);
+  } else {
+    return AsciiFindIgnoreCase(subject, lowered);
+  }
+}
+
+template <bool kLowercase>
+char FoldCase(char c) {
+  if constexpr (kLowercase) {
+    return c;
+  } else {
+    return AsciiToLower(c);
+  }
+}
+
+}  // namespace
+
+GlobMatcher::GlobMatcher(std::string_view pattern) : pattern_(pattern) {
+  if (pattern.find_first_of("[\\") != pattern.npos) {
+    kind_ = Kind::kFnmatch;
+    return;
+  }
+
+  std::string lowered(pattern);
+  AsciiToLower(lowered.data(), lowered.size(), lowered.data());
+
+  for (size_t start = 0;;) {
+    const size_t star = lowered.find('*', start);
+    const std::string_view text =
+        std::string_view(lowered).substr(start, star - start);
+
+    // Consecutive stars are the same as one, so only the anchored segments
+    // are kept when empty.
+    if (!text.empty() || segments_.empty() || star == lowered.npos) {
+      segments_.push_back(
+          {std::string(text), text.find('?') != text.npos});
+    }
+
+    if (star == lowered.npos) {
+      break;
+    }
+    start = star + 1;
+  }
+
+  const bool has_wildcards =
+      std::any_of(segments_.begin(), segments_.end(),
+                  [](const Segment& segment) { return segment.has_wildcards; });
+  const bool starts_with_star =
+      segments_.size() > 1 && segments_.front().text.empty();
+  const bool ends_with_star =
+      segments_.size() > 1 && segments_.back().text.empty();
+
+  if (has_wildcards) {
+    kind_ = Kind::kSegments;
+  } else if (segments_.size() == 1) {
+    kind_ = Kind::kExact;
+  } else if (segments_.size() == 2 && starts_with_star && ends_with_star) {
+    kind_ = Kind::kAny;
+  } else if (segments_.size() == 2 && ends_with_star) {
+    kind_ = Kind::kPrefix;
+  } else if (segments_.size() == 2 && starts_with_star) {
+    kind_ = Kind::kSuffix;
+  } else if (segments_.size() == 3 && starts_with_star && ends_with_star) {
+    kind_ = Kind::kContains;
+  } else {
+    kind_ = Kind::kSegments;
+  }
+}
+
+// static
+template <bool kLowercase>
+bool GlobMatcher::MatchesAt(std::string_view subject, const Segment& segment) {
+  if (!segment.has_wildcards) {
+    return LiteralEquals<kLowercase>(subject, segment.text);
+  }
+
+  if (subject.size() != segment.text.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < subject.size(); ++i) {
+    if (segment.text[i] != '?' &&
+        segment.text[i] != FoldCase<kLowercase>(subject[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// static
+template <bool kLowercase>
+size_t GlobMatcher::Find(std::string_view subject, const Segment& segment) {
+  if (!segment.has_wildcards) {
+    return LiteralFind<kLowercase>(subject, segment.text);
+  }
+
+  const size_t size = segment.text.size();
+  for (size_t pos = 0; pos + size <= subject.size(); ++pos) {
+    if (MatchesAt<kLowercase>(subject.substr(pos, size), segment)) {
+      return pos;
+    }
+  }
+  return subject.npos;
+}
+
+bool GlobMatcher::Matches(std::string_view subject) const {
+  return MatchesImpl<false>(subject);
+}
+
+bool GlobMatcher::MatchesLowercase(std::string_view subject) const {
+  return MatchesImpl<true>(subject);
+}
+
+bool GlobMatcher::GetLiteral(std::string_view* literal, bool* anchored_start,
+                             bool* anchored_end) const {
+  switch (kind_) {
+    case Kind::kExact:
+      *literal = segments_[0].text;
+      *anchored_start = *anchored_end = true;
+      break;
+    case Kind::kPrefix:
+      *literal = segments_[0].text;
+      *anchored_start = true;
+      *anchored_end = false;
+      break;
+    case Kind::kSuffix:
+      *literal = segments_[1].text;
+      *anchored_start = false;
+      *anchored_end = true;
+      break;
+    case Kind::kContains:
+      *literal = segments_[1].text;
+      *anchored_start = *anchored_end = false;
+      break;
+    default:
+      return false;
+  }
+
+  return !literal->empty();
+}
+
+template <bool kLowercase>
+bool GlobMatcher::MatchesImpl(std::string_view subject) const {
+  switch (kind_) {
+    case Kind::kAny:
+      return true;
+    case Kind::kExact:
+      return LiteralEquals<kLowercase>(subject, segments_[0].text);
+    case Kind::kPrefix: {
+      const std::string& prefix = segments_[0].text;
+      return subject.size() >= prefix.size() &&
+             LiteralEquals<kLowercase>(subject.substr(0, prefix.size()),
+                                       prefix);
+    }
+    case Kind::kSuffix: {
+      const std::string& suffix = segments_[1].text;
+      return subject.size() >= suffix.size() &&
+             LiteralEquals<kLowercase>(
+                 subject.substr(subject.size() - suffix.size()), suffix);
+    }
+    case Kind::kContains:
+      return LiteralFind<kLowercase>(subject, segments_[1].text) !=
+             subject.npos;
+    case Kind::kFnmatch:
+      return fnmatch(pattern_.c_str(), std::string(subject).c_str(),
+                     FNM_CASEFOLD) == 0;
+    case Kind::kSegments:
+      break;
+  }
+
+  const Segment& first = segments_.front();
+  if (segments_.size() == 1) {
+    return MatchesAt<kLowercase>(subject, first);
+  }
+
+  const Segment& last = segments_.back();
+  const size_t first_size = first.text.size();
+  const size_t last_size = last.text.size();
+  if (subject.size() < first_size + last_size ||
+      !MatchesAt<kLowercase>(subject.substr(0, first_size), first) ||
+      !MatchesAt<kLowercase>(subject.substr(subject.size() - last_size),
+                             last)) {
+    return false;
+  }
+
+  // Everything between the anchored segments is free to be matched by the
+  // stars, so the leftmost match of each remaining segment is always as good
+  // as any other.
+  std::string_view rest =
+      subject.substr(first_size, subject.size() - first_size - last_size);
+  for (size_t i = 1; i + 1 < segments_.size(); ++i) {
+    const size_t pos = Find<kLowercase>(rest, segments_[i]);
+    if (pos == rest.npos) {
+      return false;
+    }
+    rest.remove_prefix(pos + segments_[i].text.size());
+  }
+
+  return true;
+}
+
+GlobSet::GlobSet(const std::vector<GlobMatcher>& patterns) {
+  std::vector<std::string> literals;
+  for (const GlobMatcher& pattern : patterns) {
+    std::string_view literal;
+    bool anchored_start, anchored_end;
+    if (pattern.GetLiteral(&literal, &anchored_start, &anchored_end)) {
+      literals.emplace_back(literal);
+      literal_anchors_.push_back({static_cast<uint32_t>(literal.size()),
+                                  anchored_start, anchored_end});
+      scan_limit_ = anchored_start && scan_limit_ != std::string_view::npos
+                        ? std::max(scan_limit_, literal.size())
+                        : std::string_view::npos;
+    } else {
+      others_.push_back(pattern);
+    }
+  }
+
+  literals_ = AhoCorasick(literals);
+}
+
+bool GlobSet::MatchesLowercase(std::string_view subject) const {
+  auto accept = [&](uint32_t id, size_t end) {
+    const Literal& literal = literal_anchors_[id];
+    return (!literal.anchored_start || end == literal.size) &&
+           (!literal.anchored_end || end == subject.size());
+  };
+  if (literals_.Scan(subject.substr(0, scan_limit_), accept)) {
+    return true;
+  }
+
+  return std::any_of(others_.begin(), others_.end(),
+                     [&](const GlobMatcher& pattern) {
+                       return pattern.MatchesLowercase(subject);
+                     });
+}
+
+}  // namespace aur_internal
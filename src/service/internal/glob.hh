@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "service/internal/aho_corasick.hh"
+
+namespace aur_internal {
+
+// GlobMatcher is a shell-like glob pattern compiled for repeated matching. It
+// matches exactly the subjects that fnmatch(3) would with FNM_CASEFOLD in the
+// C locale, without reparsing the pattern for every subject.
+//
+// Patterns built only from literal text, '*' and '?' are split at each '*'
+// into segments, and the common shapes (exact, prefix, suffix and infix
+// literals) are matched with a single case-insensitive comparison or search.
+// The remaining shapes match the first and last segments at either end of the
+// subject and find the others greedily in between, which is exact for these
+// patterns. Patterns with bracket expressions or escapes are handed to
+// fnmatch.
+class GlobMatcher final {
+ public:
+  explicit GlobMatcher(std::string_view pattern);
+
+  GlobMatcher(GlobMatcher&&) = default;
+  GlobMatcher& operator=(GlobMatcher&&) = default;
+
+  GlobMatcher(const GlobMatcher&) = default;
+  GlobMatcher& operator=(const GlobMatcher&) = default;
+
+  bool Matches(std::string_view subject) const;
+
+  // Same as Matches(), for a |subject| that is already ASCII lowercase. This
+  // skips case folding, leaving plain byte comparisons and searches.
+  bool MatchesLowercase(std::string_view subject) const;
+
+  const std::string& pattern() const { return pattern_; }
+
+  // Returns true if every subject matches, as for "*".
+  bool MatchesEverything() const { return kind_ == Kind::kAny; }
+
+  // Returns true if the pattern is a non-empty literal, optionally preceded
+  // or followed by a star. |literal| is then set to the lowercased literal,
+  // and |anchored_start| and |anchored_end| to whether it must be found at
+  // the start and end of the subject.
+  bool GetLiteral(std::string_view* literal, bool* anchored_start,
+                  bool* anchored_end) const;
+
+ private:
+  enum class Kind {
+    kAny,       // *
+    kExact,     // literal
+    kPrefix,    // literal*
+    kSuffix,    // *literal
+    kContains,  // *literal*
+    kSegments,  // any other combination of literals, '*' and '?'
+    kFnmatch,   // bracket expressions and escapes
+  };
+
+  // Text between stars, lowercased, in which '?' matches any byte.
+  struct Segment {
+    std::string text;
+    bool has_wildcards;
+  };
+
+  // When |kLowercase| is set, the subject is known to be lowercase already.
+  template <bool kLowercase>
+  bool MatchesImpl(std::string_view subject) const;
+
+  template <bool kLowercase>
+  static bool MatchesAt(std::string_view subject, const Segment& segment);
+
+  // Returns the position of the first match of |segment| in |subject|, or
+  // npos.
+  template <bool kLowercase>
+  static size_t Find(std::string_view subject, const Segment& segment);
+
+  Kind kind_;
+  std::string pattern_;
+
+  // Segments of the pattern, split at '*'. A pattern with n stars has n + 1
+  // segments, the first and last of which are anchored.
+  std::vector<Segment> segments_;
+};
+
+// GlobSet matches a subject against several patterns at once, and succeeds
+// if any of them matches. Patterns that GlobMatcher::GetLiteral() describes
+// are combined into a single Aho-Corasick automaton, so that a subject is
+// scanned once for all of them rather than once per pattern. Any other
+// patterns are matched one at a time.
+class GlobSet final {
+ public:
+  explicit GlobSet(const std::vector<GlobMatcher>& patterns);
+
+  GlobSet(GlobSet&&) = default;
+  GlobSet& operator=(GlobSet&&) = default;
+
+  GlobSet(const GlobSet&) = delete;
+  GlobSet& operator=(const GlobSet&) = delete;
+
+  // Same as GlobMatcher::MatchesLowercase() for each pattern.
+  bool MatchesLowercase(std::string_view subject) const;
+
+ private:
+  struct Literal {
+    uint32_t size;
+    bool anchored_start;
+    bool anchored_end;
+  };
+
+  AhoCorasick literals_;
+  std::vector<Literal> literal_anchors_;
+
+  // When every literal is anchored at the start, nothing past the longest of
+  // them needs to be scanned.
+  size_t scan_limit_ = 0;
+
+  std::vector<GlobMatcher> others_;
+};
+
+}  // namespace aur_internal
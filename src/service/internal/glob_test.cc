@@ -0,0 +1,148 @@
+#include "service/internal/glob.hh"
+
+#include <fnmatch.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "service/internal/ascii.hh"
+
+using aur_internal::GlobMatcher;
+using aur_internal::GlobSet;
+
+namespace {
+
+bool Fnmatch(const std::string& pattern, const std::string& subject) {
+  return fnmatch(pattern.c_str(), subject.c_str(), FNM_CASEFOLD) == 0;
+}
+
+TEST(GlobMatcherTest, Shapes) {
+  EXPECT_TRUE(GlobMatcher("*").Matches(""));
+  EXPECT_TRUE(GlobMatcher("**").Matches("anything"));
+
+  EXPECT_TRUE(GlobMatcher("Pacman").Matches("pacMAN"));
+  EXPECT_FALSE(GlobMatcher("pacman").Matches("pacman-git"));
+  EXPECT_TRUE(GlobMatcher("").Matches(""));
+  EXPECT_FALSE(GlobMatcher("").Matches("a"));
+
+  EXPECT_TRUE(GlobMatcher("python-*").Matches("Python-Requests"));
+  EXPECT_FALSE(GlobMatcher("python-*").Matches("python2-requests"));
+
+  EXPECT_TRUE(GlobMatcher("*-git").Matches("pacman-GIT"));
+  EXPECT_FALSE(GlobMatcher("*-git").Matches("pacman-git-docs"));
+
+  EXPECT_TRUE(GlobMatcher("*FIREFOX*").Matches("a firefox extension"));
+  EXPECT_FALSE(GlobMatcher("*firefox*").Matches("fire fox"));
+
+  EXPECT_TRUE(GlobMatcher("py*req*s").Matches("python-requests"));
+  EXPECT_FALSE(GlobMatcher("py*req*s").Matches("python-request"));
+  EXPECT_TRUE(GlobMatcher("p?c*").Matches("pacman"));
+  EXPECT_FALSE(GlobMatcher("p?c").Matches("pacman"));
+  EXPECT_TRUE(GlobMatcher("*a?a*").Matches("bananas"));
+
+  EXPECT_TRUE(GlobMatcher("[pq]acman").Matches("Pacman"));
+  EXPECT_TRUE(GlobMatcher("\\*").Matches("*"));
+  EXPECT_FALSE(GlobMatcher("\\*").Matches("a"));
+}
+
+TEST(GlobMatcherTest, LongSubjects) {
+  const std::string subject =
+      "A Long Description With Plenty Of Text To Search Through, Long Enough "
+      "To Exercise Every Path Of The Vectorized Search: needle";
+  for (const char* pattern :
+       {"*NEEDLE", "*needle*", "*needlf*", "*with*search*needle",
+        "a long*vectorized*", "*e??le", "*text to search*", "*pla?ty*"}) {
+    EXPECT_EQ(GlobMatcher(pattern).Matches(subject),
+              Fnmatch(pattern, subject))
+        << pattern;
+  }
+}
+
+TEST(GlobMatcherTest, AgreesWithFnmatch) {
+  // Small alphabets make for lots of partial matches, which is where the
+  // interesting cases are. Every other pattern avoids the syntax that's left
+  // to fnmatch, so that the compiled paths get most of the coverage.
+  const std::string compiled_chars = "aAb-*?*?\xe9";
+  const std::string pattern_chars = "aAb-*?*?[]!\\\xe9";
+  const std::string subject_chars = "aAbB-*?[]\\\xe9\xc9";
+
+  std::mt19937 rng(20201017);
+  auto random_string = [&](const std::string& chars, size_t max_size) {
+    std::string s(rng() % (max_size + 1), '\0');
+    for (char& c : s) {
+      c = chars[rng() % chars.size()];
+    }
+    return s;
+  };
+
+  for (int i = 0; i < 2000; ++i) {
+    const std::string pattern =
+        random_string(i % 2 ? pattern_chars : compiled_chars, 8);
+    const GlobMatcher matcher(pattern);
+    for (int j = 0; j < 50; ++j) {
+      const std::string subject = random_string(subject_chars, 24);
+      ASSERT_EQ(matcher.Matches(subject), Fnmatch(pattern, subject))
+          << "pattern: " << pattern << " subject: " << subject;
+
+      std::string lowered = subject;
+      aur_internal::AsciiToLower(lowered.data(), lowered.size(),
+                                 lowered.data());
+      ASSERT_EQ(matcher.MatchesLowercase(lowered), Fnmatch(pattern, lowered))
+          << "pattern: " << pattern << " subject: " << lowered;
+    }
+  }
+}
+
+TEST(GlobSetTest, Shapes) {
+  const GlobSet set({GlobMatcher("pacman"), GlobMatcher("python-*"),
+                     GlobMatcher("*-git"), GlobMatcher("*fox*"),
+                     GlobMatcher("p?c*")});
+
+  EXPECT_TRUE(set.MatchesLowercase("pacman"));
+  EXPECT_TRUE(set.MatchesLowercase("python-requests"));
+  EXPECT_TRUE(set.MatchesLowercase("yay-git"));
+  EXPECT_TRUE(set.MatchesLowercase("a firefox extension"));
+  EXPECT_TRUE(set.MatchesLowercase("pic"));
+  EXPECT_FALSE(set.MatchesLowercase("yay-git-docs"));
+  EXPECT_FALSE(set.MatchesLowercase("python2-requests"));
+  EXPECT_FALSE(set.MatchesLowercase(""));
+
+  EXPECT_FALSE(GlobSet({}).MatchesLowercase("pacman"));
+  EXPECT_TRUE(GlobSet({GlobMatcher("*")}).MatchesLowercase(""));
+}
+
+TEST(GlobSetTest, AgreesWithGlobMatchers) {
+  const std::string pattern_chars = "ab-*?*";
+  const std::string subject_chars = "ab-";
+
+  std::mt19937 rng(20201017);
+  auto random_string = [&](const std::string& chars, size_t max_size) {
+    std::string s(rng() % (max_size + 1), '\0');
+    for (char& c : s) {
+      c = chars[rng() % chars.size()];
+    }
+    return s;
+  };
+
+  for (int i = 0; i < 500; ++i) {
+    std::vector<GlobMatcher> matchers;
+    for (int j = 0; j < 1 + i % 6; ++j) {
+      matchers.emplace_back(random_string(pattern_chars, 6));
+    }
+    const GlobSet set(matchers);
+    for (int j = 0; j < 50; ++j) {
+      const std::string subject = random_string(subject_chars, 16);
+      bool expected = false;
+      for (const GlobMatcher& matcher : matchers) {
+        expected = expected || matcher.MatchesLowercase(subject);
+      }
+      ASSERT_EQ(set.MatchesLowercase(subject), expected)
+          << "subject: " << subject;
+    }
+  }
+}
+
+}  // namespace
@@ -1,91 +1,697 @@
 #include "service/internal/package_index.hh"
 
-#include "absl/strings/ascii.h"
-#include "parsed_dependency.hh"
+#include <string.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+
+#include "absl/algorithm/container.h"
+#include "absl/strings/str_cat.h"
+#include "service/internal/ascii.hh"
 
 namespace aur_internal {
 
-const std::vector<const Package*>& PackageIndex::Get(
-    const std::string& key) const {
-  auto iter = index_.find(absl::AsciiStrToLower(key));
-  if (iter != index_.end()) {
-    return iter->second;
+namespace {
+
+constexpr char kImageMagic[4] = {'A', 'I', 'D', 'X'};
+constexpr uint32_t kImageVersion = 2;
+
+// Version 1 images are identical, save for always having zero flags.
+constexpr uint32_t kMinImageVersion = 1;
+
+// Set in ImageHeader::flags when the buckets hold a minimal perfect hash.
+constexpr uint32_t kPerfectHashFlag = 1 << 0;
+
+// Give up on a perfect hash bucket after this many seeds, and fall back to
+// open addressing.
+constexpr uint32_t kMaxPerfectHashSeed = 1 << 24;
+
+// A table, and so an index image, is laid out as this header followed by:
+//
+//   buckets:         uint32[num_buckets]
+//   key offsets:     uint32[num_keys + 1], into the key bytes
+//   posting offsets: uint32[num_keys + 1], into the postings
+//   postings:        uint32[num_postings], package ids
+//   keys:            char[key_bytes]
+//
+// By default, the buckets form an open-addressed hash table with linear
+// probing, keyed on ImageHash(), and hold a key id + 1, or 0 if empty.
+//
+// With kPerfectHashFlag, the buckets instead hold the seeds of a minimal
+// perfect hash in the style of hash-and-displace: a key's bucket selects a
+// seed, and the key's hash remixed with that seed is its key id. Every lookup
+// is then a single probe, and the only comparison is against that one key.
+//
+// All integers are in host byte order.
+struct ImageHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t num_packages;
+  uint32_t num_keys;
+  uint32_t num_buckets;
+  uint32_t num_postings;
+  uint32_t key_bytes;
+  uint32_t flags;
+};
+
+static_assert(sizeof(ImageHeader) == 32);
+
+// FNV-1a. Images outlive the process that creates them, so we can't use a
+// randomly seeded hash here.
+uint64_t ImageHash(std::string_view key) {
+  uint64_t hash = 14695981039346656037ull;
+  for (unsigned char c : key) {
+    hash ^= c;
+    hash *= 1099511628211ull;
   }
+  return hash;
+}
 
-  return empty_value_;
+// The murmur3 finalizer. ImageHash() is cheap but mixes poorly, and similar
+// keys would otherwise crowd into the same perfect hash buckets.
+uint64_t Mix(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdull;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ull;
+  x ^= x >> 33;
+  return x;
 }
 
-void PackageIndex::Builder::AddEntry(const std::string& key,
-                                     const Package* value) {
-  auto iter = index_.find(key);
-  if (iter == index_.end()) {
-    index_.emplace_hint(iter, key, std::vector<const Package*>{value});
-  } else {
-    iter->second.push_back(value);
-  }
+uint32_t PerfectHashBucket(uint64_t hash, uint32_t num_buckets) {
+  return Mix(hash) & (num_buckets - 1);
+}
+
+uint32_t PerfectHashSlot(uint64_t hash, uint32_t seed, uint32_t num_keys) {
+  // Maps onto [0, num_keys) without a division.
+  const uint64_t x = Mix(hash ^ ((seed + 1) * 0x9e3779b97f4a7c15ull));
+  return ((x >> 32) * num_keys) >> 32;
 }
 
-void PackageIndex::Builder::IndexPackage(const Package& package) {
-  for (const std::string& item : getter_(package)) {
-    AddEntry(absl::AsciiStrToLower(item), &package);
+// Searches for a seed per bucket such that every one of |hashes| lands in a
+// distinct slot. On success, |seeds| holds the seed of each bucket and
+// |slots| the slot of each hash. Fails if the hashes aren't distinct, or if
+// some bucket can't be placed.
+bool BuildPerfectHash(const std::vector<uint64_t>& hashes,
+                      uint32_t num_buckets, std::vector<uint32_t>* seeds,
+                      std::vector<uint32_t>* slots) {
+  const uint32_t num_keys = hashes.size();
+
+  std::vector<uint64_t> sorted_hashes = hashes;
+  std::sort(sorted_hashes.begin(), sorted_hashes.end());
+  if (std::adjacent_find(sorted_hashes.begin(), sorted_hashes.end()) !=
+      sorted_hashes.end()) {
+    return false;
+  }
+
+  std::vector<std::vector<uint32_t>> members(num_buckets);
+  for (uint32_t i = 0; i < num_keys; ++i) {
+    members[PerfectHashBucket(hashes[i], num_buckets)].push_back(i);
   }
+
+  // Place the largest buckets first, while there's still plenty of room.
+  std::vector<uint32_t> bucket_order(num_buckets);
+  for (uint32_t i = 0; i < num_buckets; ++i) {
+    bucket_order[i] = i;
+  }
+  std::stable_sort(bucket_order.begin(), bucket_order.end(),
+                   [&](uint32_t a, uint32_t b) {
+                     return members[a].size() > members[b].size();
+                   });
+
+  seeds->assign(num_buckets, 0);
+  slots->assign(num_keys, 0);
+  std::vector<bool> taken(num_keys);
+  std::vector<uint32_t> candidate;
+
+  for (uint32_t bucket : bucket_order) {
+    const auto& keys = members[bucket];
+    if (keys.empty()) {
+      break;
+    }
+
+    for (uint32_t seed = 0;; ++seed) {
+      if (seed == kMaxPerfectHashSeed) {
+        return false;
+      }
+
+      candidate.clear();
+      for (uint32_t key : keys) {
+        const uint32_t slot = PerfectHashSlot(hashes[key], seed, num_keys);
+        if (taken[slot] || absl::c_linear_search(candidate, slot)) {
+          break;
+        }
+        candidate.push_back(slot);
+      }
+
+      if (candidate.size() == keys.size()) {
+        (*seeds)[bucket] = seed;
+        for (size_t i = 0; i < keys.size(); ++i) {
+          taken[candidate[i]] = true;
+          (*slots)[keys[i]] = candidate[i];
+        }
+        break;
+      }
+    }
+  }
+
+  return true;
+}
+
+template <typename T>
+void AppendScalars(std::string* out, const T* values, size_t count) {
+  out->append(reinterpret_cast<const char*>(values), count * sizeof(T));
 }
 
+}  // namespace
+
+class PackageIndex::Table {
+ public:
+  // Opens the table laid out in |data|, which is kept alive by |pin|. Package
+  // ids are positions in |packages|. Unless |validate| is set, |data| is
+  // trusted to be well formed, as is the case for tables laid out by this
+  // process. Returns nullptr if |data| is malformed.
+  static std::shared_ptr<const Table> Open(
+      std::string_view data, std::shared_ptr<const void> pin,
+      std::shared_ptr<const std::vector<const Package*>> packages,
+      bool validate);
+
+  size_t num_keys() const { return header_.num_keys; }
+  bool perfect_hash() const { return header_.flags & kPerfectHashFlag; }
+
+  Postings Find(std::string_view key) const {
+    if (perfect_hash()) {
+      const uint64_t hash = ImageHash(key);
+      const uint32_t seed =
+          buckets_[PerfectHashBucket(hash, header_.num_buckets)];
+      const uint32_t id = PerfectHashSlot(hash, seed, header_.num_keys);
+      return this->key(id) == key ? postings(id) : Postings();
+    }
+
+    const uint32_t mask = header_.num_buckets - 1;
+    uint32_t bucket = ImageHash(key) & mask;
+    for (;; bucket = (bucket + 1) & mask) {
+      const uint32_t slot = buckets_[bucket];
+      if (slot == 0) {
+        return {};
+      }
+
+      if (this->key(slot - 1) == key) {
+        return postings(slot - 1);
+      }
+    }
+  }
+
+  // Invokes fn(key, postings) for every key in the table.
+  template <typename Fn>
+  void ForEach(const Fn& fn) const {
+    for (uint32_t id = 0; id < header_.num_keys; ++id) {
+      fn(key(id), postings(id));
+    }
+  }
+
+ private:
+  Table() = default;
+
+  std::string_view key(uint32_t id) const {
+    return std::string_view(keys_ + key_offsets_[id],
+                            key_offsets_[id + 1] - key_offsets_[id]);
+  }
+
+  Postings postings(uint32_t id) const {
+    return Postings(postings_ + posting_offsets_[id],
+                    posting_offsets_[id + 1] - posting_offsets_[id],
+                    packages_->data());
+  }
+
+  std::shared_ptr<const void> pin_;
+  std::shared_ptr<const std::vector<const Package*>> packages_;
+
+  ImageHeader header_;
+  const uint32_t* buckets_;
+  const uint32_t* key_offsets_;
+  const uint32_t* posting_offsets_;
+  const uint32_t* postings_;
+  const char* keys_;
+};
+
 // static
-PackageIndex PackageIndex::Create(const std::vector<Package>& packages,
-                                  const std::string& index_name,
-                                  SecondaryValueFn fn) {
-  Builder builder(std::move(fn));
-  for (const auto& p : packages) {
-    builder.IndexPackage(p);
+std::shared_ptr<const PackageIndex::Table> PackageIndex::Table::Open(
+    std::string_view data, std::shared_ptr<const void> pin,
+    std::shared_ptr<const std::vector<const Package*>> packages,
+    bool validate) {
+  std::shared_ptr<Table> table(new Table);
+
+  auto& header = table->header_;
+  if (data.size() < sizeof(header) ||
+      reinterpret_cast<uintptr_t>(data.data()) % alignof(uint32_t) != 0) {
+    return nullptr;
+  }
+  memcpy(&header, data.data(), sizeof(header));
+
+  if (validate) {
+    if (memcmp(header.magic, kImageMagic, sizeof(kImageMagic)) != 0 ||
+        header.version < kMinImageVersion || header.version > kImageVersion ||
+        (header.flags & ~kPerfectHashFlag) != 0 ||
+        header.num_packages != packages->size() || header.num_buckets == 0 ||
+        (header.num_buckets & (header.num_buckets - 1)) != 0) {
+      return nullptr;
+    }
+
+    // A perfect hash may have fewer buckets than keys, but needs at least
+    // one key to map onto. Open addressing needs a free bucket to terminate.
+    const bool perfect_hash = header.flags & kPerfectHashFlag;
+    if (perfect_hash ? header.num_keys == 0
+                     : header.num_keys >= header.num_buckets) {
+      return nullptr;
+    }
+
+    const uint64_t expected_size =
+        sizeof(header) +
+        sizeof(uint32_t) * (uint64_t{header.num_buckets} +
+                            2 * (uint64_t{header.num_keys} + 1) +
+                            header.num_postings) +
+        header.key_bytes;
+    if (data.size() != expected_size) {
+      return nullptr;
+    }
+  }
+
+  table->buckets_ =
+      reinterpret_cast<const uint32_t*>(data.data() + sizeof(header));
+  table->key_offsets_ = table->buckets_ + header.num_buckets;
+  table->posting_offsets_ = table->key_offsets_ + header.num_keys + 1;
+  table->postings_ = table->posting_offsets_ + header.num_keys + 1;
+  table->keys_ =
+      reinterpret_cast<const char*>(table->postings_ + header.num_postings);
+
+  if (validate) {
+    // Check everything that we'll later trust blindly while serving. Any
+    // seed is safe to follow, so only open addressing buckets need checking.
+    // Every key must occupy exactly one bucket, which leaves the free bucket
+    // that ends every probe.
+    if (!(header.flags & kPerfectHashFlag)) {
+      std::vector<bool> occupied(header.num_keys);
+      for (uint32_t i = 0; i < header.num_buckets; ++i) {
+        const uint32_t slot = table->buckets_[i];
+        if (slot == 0) {
+          continue;
+        }
+        if (slot > header.num_keys || occupied[slot - 1]) {
+          return nullptr;
+        }
+        occupied[slot - 1] = true;
+      }
+    }
+
+    auto monotonic = [](const uint32_t* offsets, uint32_t count,
+                        uint32_t end) {
+      if (offsets[0] != 0 || offsets[count] != end) {
+        return false;
+      }
+      for (uint32_t i = 0; i < count; ++i) {
+        if (offsets[i] > offsets[i + 1]) {
+          return false;
+        }
+      }
+      return true;
+    };
+    if (!monotonic(table->key_offsets_, header.num_keys, header.key_bytes) ||
+        !monotonic(table->posting_offsets_, header.num_keys,
+                   header.num_postings)) {
+      return nullptr;
+    }
+
+    for (uint32_t i = 0; i < header.num_postings; ++i) {
+      if (table->postings_[i] >= packages->size()) {
+        return nullptr;
+      }
+    }
   }
-  return builder.Build(index_name);
+
+  table->pin_ = std::move(pin);
+  table->packages_ = std::move(packages);
+  return table;
 }
 
-// static
-PackageIndex::SecondaryValueFn PackageIndex::DepstringFieldIndexingAdapter(
-    const google::protobuf::RepeatedPtrField<std::string>& (
-        Package::*depstring_field)() const) {
-  return [=](const Package& p) {
-    google::protobuf::RepeatedPtrField<std::string> field;
+// TableBuilder accumulates (key, package) pairs and lays them out as a Table.
+// Keys must already be lowercased. Packages are identified by their position
+// in a table shared with the built Table, and are listed under a key in the
+// order that they were added.
+class PackageIndex::TableBuilder {
+ public:
+  explicit TableBuilder(
+      std::shared_ptr<const std::vector<const Package*>> packages)
+      : packages_(std::move(packages)) {}
 
-    for (const auto& depstring : (p.*depstring_field)()) {
-      *field.Add() = ParsedDependency(depstring).name();
+  TableBuilder(TableBuilder&&) = delete;
+  TableBuilder& operator=(TableBuilder&&) = delete;
+
+  TableBuilder(const TableBuilder&) = delete;
+  TableBuilder& operator=(const TableBuilder&) = delete;
+
+  void Add(std::string_view key, uint32_t package_id) {
+    auto key_iter = key_ids_.find(key);
+    if (key_iter == key_ids_.end()) {
+      key_iter = key_ids_.emplace(std::string(key), key_ids_.size()).first;
     }
+    entries_.emplace_back(key_iter->second, package_id);
+  }
 
-    return field;
-  };
+  // Like the above, but finds the position of |package| first. Returns false
+  // if |package| isn't in the table.
+  bool Add(std::string_view key, const Package* package) {
+    if (package_ids_.empty()) {
+      package_ids_.reserve(packages_->size());
+      for (uint32_t i = 0; i < packages_->size(); ++i) {
+        package_ids_.emplace((*packages_)[i], i);
+      }
+    }
+
+    auto iter = package_ids_.find(package);
+    if (iter == package_ids_.end()) {
+      return false;
+    }
+
+    Add(key, iter->second);
+    return true;
+  }
+
+  size_t num_keys() const { return key_ids_.size(); }
+
+  // Requests a minimal perfect hash rather than open addressing. The builder
+  // falls back to open addressing if no perfect hash can be found.
+  void set_perfect_hash(bool perfect_hash) { perfect_hash_ = perfect_hash; }
+
+  // Lays out the accumulated entries, so that the same entries always produce
+  // the same layout.
+  std::string Serialize() const;
+
+  std::shared_ptr<const Table> Build() const {
+    auto data = std::make_shared<const std::string>(Serialize());
+    const std::string_view view = *data;
+    return Table::Open(view, std::move(data), packages_, /*validate=*/false);
+  }
+
+ private:
+  absl::flat_hash_map<std::string, uint32_t, KeyHash, KeyEq> key_ids_;
+  std::shared_ptr<const std::vector<const Package*>> packages_;
+  bool perfect_hash_ = false;
+
+  // Built on first use by Add(), for callers holding packages rather than
+  // their ids.
+  absl::flat_hash_map<const Package*, uint32_t> package_ids_;
+
+  // Pairs of key id and package id.
+  std::vector<std::pair<uint32_t, uint32_t>> entries_;
+};
+
+std::string PackageIndex::TableBuilder::Serialize() const {
+  std::vector<std::string_view> keys(key_ids_.size());
+  for (const auto& [key, id] : key_ids_) {
+    keys[id] = key;
+  }
+
+  // Keys are laid out in |order|. With a perfect hash, a key's position is
+  // its slot, and otherwise keys are sorted.
+  std::vector<uint32_t> order(keys.size());
+  std::vector<uint32_t> seeds;
+  bool perfect_hash = false;
+  if (perfect_hash_ && !keys.empty()) {
+    std::vector<uint64_t> hashes(keys.size());
+    for (uint32_t id = 0; id < keys.size(); ++id) {
+      hashes[id] = ImageHash(keys[id]);
+    }
+
+    // Two keys per bucket on average keeps the seed search short.
+    uint32_t num_buckets = 1;
+    while (num_buckets < keys.size() / 2) {
+      num_buckets *= 2;
+    }
+
+    std::vector<uint32_t> slots;
+    perfect_hash = BuildPerfectHash(hashes, num_buckets, &seeds, &slots);
+    if (perfect_hash) {
+      for (uint32_t id = 0; id < keys.size(); ++id) {
+        order[slots[id]] = id;
+      }
+    }
+  }
+
+  if (!perfect_hash) {
+    for (uint32_t id = 0; id < order.size(); ++id) {
+      order[id] = id;
+    }
+    std::sort(order.begin(), order.end(),
+              [&](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+  }
+
+  std::vector<uint32_t> rank(keys.size());
+  for (uint32_t i = 0; i < order.size(); ++i) {
+    rank[order[i]] = i;
+  }
+
+  ImageHeader header{};
+  memcpy(header.magic, kImageMagic, sizeof(kImageMagic));
+  header.version = kImageVersion;
+  header.num_packages = packages_->size();
+  header.num_keys = keys.size();
+  header.num_postings = entries_.size();
+
+  // Counting sort of the entries by the rank of their key. The sort is stable,
+  // which preserves the order that packages were added in.
+  std::vector<uint32_t> posting_offsets(keys.size() + 1);
+  for (const auto& [key_id, package_id] : entries_) {
+    ++posting_offsets[rank[key_id] + 1];
+  }
+  for (size_t i = 1; i < posting_offsets.size(); ++i) {
+    posting_offsets[i] += posting_offsets[i - 1];
+  }
+
+  std::vector<uint32_t> postings(entries_.size());
+  std::vector<uint32_t> next(posting_offsets.begin(),
+                             posting_offsets.end() - 1);
+  for (const auto& [key_id, package_id] : entries_) {
+    postings[next[rank[key_id]]++] = package_id;
+  }
+
+  std::vector<uint32_t> buckets;
+  if (perfect_hash) {
+    header.flags |= kPerfectHashFlag;
+    buckets = std::move(seeds);
+  } else {
+    uint32_t num_buckets = 1;
+    while (num_buckets < 2 * header.num_keys + 1) {
+      num_buckets *= 2;
+    }
+    buckets.resize(num_buckets);
+
+    const uint32_t mask = num_buckets - 1;
+    for (uint32_t i = 0; i < order.size(); ++i) {
+      uint32_t bucket = ImageHash(keys[order[i]]) & mask;
+      while (buckets[bucket] != 0) {
+        bucket = (bucket + 1) & mask;
+      }
+      buckets[bucket] = i + 1;
+    }
+  }
+  header.num_buckets = buckets.size();
+
+  std::vector<uint32_t> key_offsets{0};
+  key_offsets.reserve(keys.size() + 1);
+  std::string key_bytes;
+  for (uint32_t id : order) {
+    key_bytes.append(keys[id]);
+    key_offsets.push_back(key_bytes.size());
+  }
+  header.key_bytes = key_bytes.size();
+
+  std::string image;
+  image.reserve(sizeof(header) +
+                sizeof(uint32_t) * (buckets.size() + key_offsets.size() +
+                                    posting_offsets.size() + postings.size()) +
+                key_bytes.size());
+  AppendScalars(&image, &header, 1);
+  AppendScalars(&image, buckets.data(), buckets.size());
+  AppendScalars(&image, key_offsets.data(), key_offsets.size());
+  AppendScalars(&image, posting_offsets.data(), posting_offsets.size());
+  AppendScalars(&image, postings.data(), postings.size());
+  image.append(key_bytes);
+
+  return image;
 }
 
+PackageIndex::PackageIndex(const std::string& index_name,
+                           KeyExtractorFn extractor,
+                           std::shared_ptr<const Table> table,
+                           bool perfect_hash)
+    : name_(index_name),
+      extractor_(std::move(extractor)),
+      perfect_hash_(perfect_hash),
+      table_(std::move(table)) {}
+
 // static
-PackageIndex::SecondaryValueFn PackageIndex::ScalarFieldIndexingAdapter(
-    const std::string& (Package::*scalar_field)() const) {
-  return [=](const Package& p) {
-    google::protobuf::RepeatedPtrField<std::string> field;
-    *field.Add() = (p.*scalar_field)();
-    return field;
+bool PackageIndex::FromImage(
+    const std::string& index_name, std::string_view image,
+    std::shared_ptr<const void> pin,
+    std::shared_ptr<const std::vector<const Package*>> packages,
+    PackageIndex* index) {
+  auto table = Table::Open(image, std::move(pin), std::move(packages),
+                           /*validate=*/true);
+  if (table == nullptr) {
+    return false;
+  }
+
+  const bool perfect_hash = table->perfect_hash();
+  *index = PackageIndex(index_name, nullptr, std::move(table), perfect_hash);
+  return true;
+}
+
+bool PackageIndex::ToImage(
+    std::shared_ptr<const std::vector<const Package*>> packages,
+    std::string* image) const {
+  TableBuilder builder(std::move(packages));
+  builder.set_perfect_hash(perfect_hash_);
+
+  bool success = true;
+  auto add = [&](std::string_view key, const Postings& postings) {
+    for (const Package* package : postings) {
+      success = success && builder.Add(key, package);
+    }
   };
+
+  if (table_ != nullptr) {
+    table_->ForEach([&](std::string_view key, const Postings& postings) {
+      if (!overlay_.contains(key)) {
+        add(key, postings);
+      }
+    });
+  }
+  for (const auto& [key, value] : overlay_) {
+    add(key, Postings(value));
+  }
+
+  if (!success) {
+    return false;
+  }
+
+  *image = builder.Serialize();
+  return true;
 }
 
-// static
-PackageIndex::SecondaryValueFn PackageIndex::RepeatedFieldIndexingAdapter(
-    const google::protobuf::RepeatedPtrField<std::string>& (
-        Package::*repeated_field)() const,
-    bool synthesize_empty) {
-  if (synthesize_empty) {
-    return [=](const Package& p) {
-      const auto& v = (p.*repeated_field)();
-      if (v.empty()) {
-        google::protobuf::RepeatedPtrField<std::string> field;
-        *field.Add() = "";
-        return field;
-      } else {
-        return v;
+PackageIndex::Postings PackageIndex::Get(std::string_view key) const {
+  const LowercasedKey lowered(key);
+
+  if (!overlay_.empty()) {
+    if (auto iter = overlay_.find(lowered.view()); iter != overlay_.end()) {
+      return Postings(iter->second);
+    }
+  }
+
+  return GetFromTable(lowered.view());
+}
+
+PackageIndex::Postings PackageIndex::GetFromTable(std::string_view key) const {
+  if (table_ == nullptr) {
+    return {};
+  }
+
+  return table_->Find(key);
+}
+
+std::vector<const Package*>& PackageIndex::MutableEntry(
+    std::string_view key) {
+  auto iter = overlay_.find(key);
+  if (iter != overlay_.end()) {
+    return iter->second;
+  }
+
+  const auto postings = GetFromTable(key);
+  return overlay_
+      .emplace(std::string(key),
+               std::vector<const Package*>(postings.begin(), postings.end()))
+      .first->second;
+}
+
+PackageIndex PackageIndex::Patch(
+    const std::vector<const Package*>& removed,
+    const std::vector<const Package*>& added,
+    std::shared_ptr<const std::vector<const Package*>> packages) const {
+  PackageIndex patched(name_, extractor_, table_, perfect_hash_);
+  patched.overlay_ = overlay_;
+
+  for (const Package* package : removed) {
+    extractor_(*package, [&](std::string_view key) {
+      auto& entry = patched.MutableEntry(LowercasedKey(key).view());
+      entry.erase(std::remove(entry.begin(), entry.end(), package),
+                  entry.end());
+    });
+  }
+
+  for (const Package* package : added) {
+    extractor_(*package, [&](std::string_view key) {
+      patched.MutableEntry(LowercasedKey(key).view()).push_back(package);
+    });
+  }
+
+  // Fold the overlay back into a fresh table once it accounts for a
+  // significant portion of the index, so that lookups don't pay for two
+  // probes forever. The overlay is kept as is if it refers to a package
+  // outside of |packages|.
+  const size_t table_keys = table_ != nullptr ? table_->num_keys() : 0;
+  if (patched.overlay_.size() > table_keys / 4) {
+    TableBuilder builder(std::move(packages));
+    builder.set_perfect_hash(perfect_hash_);
+
+    bool success = true;
+    auto add = [&](std::string_view key, const Postings& postings) {
+      for (const Package* package : postings) {
+        success = success && builder.Add(key, package);
       }
     };
-  } else {
-    return [=](const Package& p) { return (p.*repeated_field)(); };
+
+    if (table_ != nullptr) {
+      table_->ForEach([&](std::string_view key, const Postings& postings) {
+        if (!patched.overlay_.contains(key)) {
+          add(key, postings);
+        }
+      });
+    }
+    for (const auto& [key, value] : patched.overlay_) {
+      add(key, Postings(value));
+    }
+
+    if (success) {
+      patched.table_ = builder.Build();
+      patched.overlay_.clear();
+    }
   }
+
+  return patched;
+}
+
+PackageIndex::Builder::Builder(
+    std::shared_ptr<const std::vector<const Package*>> packages,
+    bool perfect_hash)
+    : perfect_hash_(perfect_hash),
+      table_(std::make_unique<TableBuilder>(std::move(packages))) {
+  table_->set_perfect_hash(perfect_hash);
+}
+
+PackageIndex::Builder::~Builder() = default;
+
+void PackageIndex::Builder::Add(std::string_view key, uint32_t package_id) {
+  table_->Add(LowercasedKey(key).view(), package_id);
+}
+
+PackageIndex PackageIndex::Builder::Build(const std::string& index_name,
+                                          KeyExtractorFn extractor) {
+  // Indexes may be built concurrently, so emit the message in one write.
+  std::cout << absl::StrCat(index_name, " index built with ",
+                            table_->num_keys(), " terms.\n");
+  return PackageIndex(index_name, std::move(extractor), table_->Build(),
+                      perfect_hash_);
 }
 
 }  // namespace aur_internal
@@ -1,13 +1,20 @@
 #pragma once
 
-#include <iostream>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
 #include "absl/container/flat_hash_map.h"
+#include "absl/functional/function_ref.h"
 #include "aur_internal.pb.h"
 #include "google/protobuf/repeated_field.h"
+#include "service/internal/parsed_dependency.hh"
 
 namespace aur_internal {
 
@@ -15,29 +22,198 @@ namespace aur_internal {
 // key. Indexes are made space efficient by keeping only pointers to Packages.
 // Thus, care must be taken to ensure that the lifetime of a PackageIndex does
 // not exceed the lifetime of the backing store that a PackageIndex depends on.
+//
+// The bulk of an index lives in a compact, immutable table: keys are stored
+// back to back in a single buffer, and the packages for every key are stored
+// as 32-bit ids in a single postings array, with a hash table over the keys to
+// find them. The same layout doubles as the serialized image of an index, so
+// an index can be written out with ToImage() and served straight out of that
+// image with FromImage().
+//
+// An index may be derived from another with Patch(). A patched index shares
+// the table of the index it was derived from, and keeps only the entries
+// affected by the patch in a separate overlay.
 class PackageIndex final {
  public:
+  // The packages found for a key. This is a lightweight view into the index,
+  // and is only valid for as long as the index is.
+  class Postings {
+   public:
+    class const_iterator {
+     public:
+      using iterator_category = std::forward_iterator_tag;
+      using value_type = const Package*;
+      using difference_type = std::ptrdiff_t;
+      using pointer = const value_type*;
+      using reference = value_type;
+
+      const_iterator() = default;
+
+      value_type operator*() const {
+        return ids_ != nullptr ? packages_[ids_[i_]] : packages_[i_];
+      }
+
+      const_iterator& operator++() {
+        ++i_;
+        return *this;
+      }
+      const_iterator operator++(int) {
+        const_iterator copy = *this;
+        ++i_;
+        return copy;
+      }
+
+      bool operator==(const const_iterator& other) const {
+        return i_ == other.i_;
+      }
+      bool operator!=(const const_iterator& other) const {
+        return i_ != other.i_;
+      }
+
+     private:
+      friend class Postings;
+
+      const_iterator(const uint32_t* ids, const Package* const* packages,
+                     size_t i)
+          : ids_(ids), packages_(packages), i_(i) {}
+
+      const uint32_t* ids_ = nullptr;
+      const Package* const* packages_ = nullptr;
+      size_t i_ = 0;
+    };
+
+    using value_type = const Package*;
+    using size_type = size_t;
+    using iterator = const_iterator;
+
+    Postings() = default;
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    const_iterator begin() const { return const_iterator(ids_, packages_, 0); }
+    const_iterator end() const {
+      return const_iterator(ids_, packages_, size_);
+    }
+
+   private:
+    friend class PackageIndex;
+
+    // Postings held as ids into a table of |packages|.
+    Postings(const uint32_t* ids, size_t size, const Package* const* packages)
+        : ids_(ids), packages_(packages), size_(size) {}
+
+    // Postings held directly as |packages|.
+    explicit Postings(const std::vector<const Package*>& packages)
+        : packages_(packages.data()), size_(packages.size()) {}
+
+    const uint32_t* ids_ = nullptr;
+    const Package* const* packages_ = nullptr;
+    size_t size_ = 0;
+  };
+
   PackageIndex() {}
 
-  using SecondaryValueFn =
-      std::function<google::protobuf::RepeatedPtrField<std::string>(
-          const Package&)>;
+  // Receives the keys of a package, one at a time. Keys are views into the
+  // package, and are only valid for the duration of the call.
+  using KeyCallback = absl::FunctionRef<void(std::string_view)>;
+
+  // Type-erased form of a key extractor, kept by an index so that it can be
+  // patched later.
+  using KeyExtractorFn = std::function<void(const Package&, KeyCallback)>;
+
+  // Key extractors are callables with the signature:
+  //
+  //   template <typename Fn>
+  //   void operator()(const Package& package, const Fn& fn) const;
+  //
+  // which invoke fn(std::string_view) once for each key of |package|. Indexes
+  // are built by extractors inlined into the build loop, so keys are never
+  // copied out of the package.
+
+  // Indexes a package by the names in a repeated field of depstrings.
+  struct DepstringFieldExtractor {
+    template <typename Fn>
+    void operator()(const Package& package, const Fn& fn) const {
+      for (const std::string& depstring : (package.*field)()) {
+        fn(ParsedDependency::Name(depstring));
+      }
+    }
+
+    const google::protobuf::RepeatedPtrField<std::string>& (
+        Package::*field)() const;
+  };
+
+  // Indexes a package by a scalar field.
+  struct ScalarFieldExtractor {
+    template <typename Fn>
+    void operator()(const Package& package, const Fn& fn) const {
+      fn((package.*field)());
+    }
+
+    const std::string& (Package::*field)() const;
+  };
 
-  static SecondaryValueFn DepstringFieldIndexingAdapter(
+  // Indexes a package by each value of a repeated field. If
+  // |synthesize_empty| is set, a package with no values is indexed by the
+  // empty string instead.
+  struct RepeatedFieldExtractor {
+    template <typename Fn>
+    void operator()(const Package& package, const Fn& fn) const {
+      const auto& values = (package.*field)();
+      if (values.empty() && synthesize_empty) {
+        fn(std::string_view());
+      }
+      for (const std::string& value : values) {
+        fn(value);
+      }
+    }
+
+    const google::protobuf::RepeatedPtrField<std::string>& (
+        Package::*field)() const;
+    bool synthesize_empty;
+  };
+
+  static DepstringFieldExtractor DepstringFieldIndexingAdapter(
       const google::protobuf::RepeatedPtrField<std::string>& (
-          Package::*depstring_field)() const);
+          Package::*depstring_field)() const) {
+    return {depstring_field};
+  }
 
-  static SecondaryValueFn ScalarFieldIndexingAdapter(
-      const std::string& (Package::*scalar_field)() const);
+  static ScalarFieldExtractor ScalarFieldIndexingAdapter(
+      const std::string& (Package::*scalar_field)() const) {
+    return {scalar_field};
+  }
 
-  static SecondaryValueFn RepeatedFieldIndexingAdapter(
+  static RepeatedFieldExtractor RepeatedFieldIndexingAdapter(
       const google::protobuf::RepeatedPtrField<std::string>& (
           Package::*repeated_field)() const,
-      bool synthesize_empty = false);
+      bool synthesize_empty = false) {
+    return {repeated_field, synthesize_empty};
+  }
+
+  // Creates an index of |packages| keyed by |extractor|. Packages are held as
+  // their positions in |packages|, which is shared rather than copied, so that
+  // every index of a snapshot can refer to the same table. If |perfect_hash|
+  // is set, keys are found through a minimal perfect hash, which takes longer
+  // to build but answers every lookup with a single probe. This suits indexes
+  // which are hit hard and rarely patched.
+  template <typename Extractor>
+  static PackageIndex Create(
+      std::shared_ptr<const std::vector<const Package*>> packages,
+      const std::string& index_name, const Extractor& extractor,
+      bool perfect_hash = false) {
+    Builder builder(packages, perfect_hash);
+    for (uint32_t id = 0; id < packages->size(); ++id) {
+      extractor(*(*packages)[id],
+                [&](std::string_view key) { builder.Add(key, id); });
+    }
 
-  static PackageIndex Create(const std::vector<Package>& packages,
-                             const std::string& index_name,
-                             SecondaryValueFn fn);
+    return builder.Build(
+        index_name, [extractor](const Package& package, KeyCallback fn) {
+          extractor(package, fn);
+        });
+  }
 
   PackageIndex(PackageIndex&&) = default;
   PackageIndex& operator=(PackageIndex&&) = default;
@@ -45,17 +221,69 @@ class PackageIndex final {
   PackageIndex(const PackageIndex&) = delete;
   PackageIndex& operator=(const PackageIndex&) = delete;
 
-  // Lookup the packages associated with the given key. An empty vector is
-  // returned when the key is not found in the index.
-  const std::vector<const Package*>& Get(const std::string& key) const;
+  // Creates an index served out of |image|, which was created by ToImage()
+  // with the same |packages| in the same order. |pin| must keep |image| alive
+  // for as long as it's held. Returns false if the image is malformed or was
+  // created for a different set of packages. Indexes created this way can't
+  // be patched.
+  static bool FromImage(
+      const std::string& index_name, std::string_view image,
+      std::shared_ptr<const void> pin,
+      std::shared_ptr<const std::vector<const Package*>> packages,
+      PackageIndex* index);
+
+  const std::string& name() const { return name_; }
+
+  // Lookup the packages associated with the given key, ignoring ASCII case.
+  // Empty postings are returned when the key is not found in the index. Keys
+  // are folded on the stack, so lookups don't allocate.
+  Postings Get(std::string_view key) const;
+
+  // Returns a new index derived from this one, with the |removed| packages
+  // dropped and the |added| packages indexed. |packages| is the table of the
+  // snapshot that the patched index belongs to. The cost of a patch is
+  // proportional to the number of entries touched by the given packages, and
+  // the overlay is folded back into a fresh table over |packages| once it
+  // grows large.
+  PackageIndex Patch(
+      const std::vector<const Package*>& removed,
+      const std::vector<const Package*>& added,
+      std::shared_ptr<const std::vector<const Package*>> packages) const;
+
+  // Serializes the index into |image|, suitable for FromImage(). Packages are
+  // recorded by their position in |packages|. Returns false if the index
+  // refers to a package which isn't in |packages|.
+  bool ToImage(std::shared_ptr<const std::vector<const Package*>> packages,
+               std::string* image) const;
 
  private:
-  using container_type =
-      absl::flat_hash_map<std::string, std::vector<const Package*>>;
+  class Table;
+  class TableBuilder;
+
+  // Lets the overlay be probed with a std::string_view, without first copying
+  // it into a std::string.
+  struct KeyHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view key) const {
+      return absl::Hash<std::string_view>{}(key);
+    }
+  };
+  struct KeyEq {
+    using is_transparent = void;
+    bool operator()(std::string_view a, std::string_view b) const {
+      return a == b;
+    }
+  };
+
+  using overlay_type = absl::flat_hash_map<std::string,
+                                           std::vector<const Package*>,
+                                           KeyHash, KeyEq>;
 
   class Builder {
    public:
-    explicit Builder(SecondaryValueFn getter) : getter_(std::move(getter)) {}
+    Builder(std::shared_ptr<const std::vector<const Package*>> packages,
+            bool perfect_hash);
+    ~Builder();
 
     Builder(Builder&&) = delete;
     Builder& operator=(Builder&&) = delete;
@@ -63,31 +291,41 @@ class PackageIndex final {
     Builder(const Builder&) = delete;
     Builder& operator=(const Builder&) = delete;
 
-    void IndexPackage(const Package& package);
+    // Adds |key| for the package at |package_id| in the table.
+    void Add(std::string_view key, uint32_t package_id);
 
-    PackageIndex Build(const std::string& index_name) {
-      index_.rehash(0);
-      std::cout << index_name << " index built with " << index_.size()
-                << " terms.\n";
-      return PackageIndex(index_name, std::move(index_));
-    }
+    PackageIndex Build(const std::string& index_name,
+                       KeyExtractorFn extractor);
 
    private:
-    void AddEntry(const std::string& key, const Package* value);
-
-    const SecondaryValueFn getter_;
-    container_type index_;
+    const bool perfect_hash_;
+    std::unique_ptr<TableBuilder> table_;
   };
 
   // Private constructor. PackageIndex objects must be created through the
   // static Create method.
-  explicit PackageIndex(const std::string& index_name, container_type index)
-      : name_(index_name), index_(std::move(index)) {}
+  PackageIndex(const std::string& index_name, KeyExtractorFn extractor,
+               std::shared_ptr<const Table> table, bool perfect_hash);
+
+  // Lookup |key|, which must already be lowercased, ignoring the overlay.
+  Postings GetFromTable(std::string_view key) const;
 
-  inline static const container_type::value_type::second_type empty_value_;
+  // Returns a mutable copy of the entry for |key| in the overlay, seeding it
+  // from the table if it isn't already present in the overlay.
+  std::vector<const Package*>& MutableEntry(std::string_view key);
 
   std::string name_;
-  container_type index_;
+  KeyExtractorFn extractor_;
+
+  // Whether tables built for this index should use a perfect hash.
+  bool perfect_hash_ = false;
+
+  // Entries shared with the index this one was derived from.
+  std::shared_ptr<const Table> table_;
+
+  // Entries which differ from table_. An empty vector marks a key that has
+  // been removed.
+  overlay_type overlay_;
 };
 
 }  // namespace aur_internal
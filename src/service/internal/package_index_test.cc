@@ -1,5 +1,9 @@
 #include "service/internal/package_index.hh"
 
+#include <string.h>
+
+#include "absl/strings/ascii.h"
+#include "absl/strings/str_cat.h"
 #include "absl/strings/str_join.h"
 #include "aur_internal.pb.h"
 #include "gmock/gmock.h"
@@ -13,6 +17,21 @@ using testing::UnorderedElementsAre;
 
 namespace {
 
+std::shared_ptr<const std::vector<const Package*>> PackageTable(
+    std::vector<const Package*> packages) {
+  return std::make_shared<const std::vector<const Package*>>(
+      std::move(packages));
+}
+
+std::shared_ptr<const std::vector<const Package*>> PackagePointers(
+    const std::vector<Package>& packages) {
+  std::vector<const Package*> pointers;
+  for (const auto& p : packages) {
+    pointers.push_back(&p);
+  }
+  return PackageTable(std::move(pointers));
+}
+
 TEST(PackageIndexTest, IndexByRepeatedFieldAdapter) {
   std::vector<Package> packages;
   {
@@ -38,7 +57,7 @@ TEST(PackageIndexTest, IndexByRepeatedFieldAdapter) {
   }
 
   auto index = PackageIndex::Create(
-      packages, "maintainers",
+      PackagePointers(packages), "maintainers",
       PackageIndex::RepeatedFieldIndexingAdapter(&Package::maintainers));
 
   EXPECT_THAT(index.Get("falconindy"),
@@ -66,7 +85,7 @@ TEST(PackageIndexTest, IndexByRepeatedFieldAdapterWithSyntheticEmpty) {
   }
 
   auto index = PackageIndex::Create(
-      packages, "maintainers",
+      PackagePointers(packages), "maintainers",
       PackageIndex::RepeatedFieldIndexingAdapter(&Package::maintainers, true));
 
   EXPECT_THAT(index.Get(""),
@@ -87,7 +106,7 @@ TEST(PackageIndexTest, IndexByDepstringFieldAdapter) {
   }
 
   auto index = PackageIndex::Create(
-      packages, "provides",
+      PackagePointers(packages), "provides",
       PackageIndex::DepstringFieldIndexingAdapter(&Package::provides));
 
   EXPECT_THAT(index.Get("auracle"),
@@ -106,7 +125,7 @@ TEST(PackageIndexTest, IndexByScalarFieldAdapter) {
   }
 
   auto index = PackageIndex::Create(
-      packages, "pkgbase",
+      PackagePointers(packages), "pkgbase",
       PackageIndex::ScalarFieldIndexingAdapter(&Package::pkgbase));
 
   EXPECT_THAT(index.Get("auracle"),
@@ -114,4 +133,190 @@ TEST(PackageIndexTest, IndexByScalarFieldAdapter) {
   EXPECT_THAT(index.Get("notfound"), IsEmpty());
 }
 
+TEST(PackageIndexTest, GetIgnoresCase) {
+  const std::string long_name(300, 'x');
+
+  std::vector<Package> packages(3);
+  packages[0].set_name("Auracle");
+  packages[1].set_name("pkgfile");
+  packages[2].set_name(long_name);
+
+  auto index = PackageIndex::Create(
+      PackagePointers(packages), "pkgname",
+      PackageIndex::ScalarFieldIndexingAdapter(&Package::name));
+
+  EXPECT_THAT(index.Get("auracle"),
+              UnorderedElementsAre(Property(&Package::name, "Auracle")));
+  EXPECT_THAT(index.Get(std::string_view("PKGFILE and more", 7)),
+              UnorderedElementsAre(Property(&Package::name, "pkgfile")));
+  EXPECT_THAT(index.Get(std::string(300, 'X')),
+              UnorderedElementsAre(Property(&Package::name, long_name)));
+
+  // Keys held in the overlay of a patched index are matched the same way.
+  Package added;
+  added.set_name("Expac");
+  auto patched =
+      index.Patch({}, {&added},
+                  PackageTable({&packages[0], &packages[1], &packages[2],
+                                &added}));
+  EXPECT_THAT(patched.Get("EXPAC"),
+              UnorderedElementsAre(Property(&Package::name, "Expac")));
+}
+
+TEST(PackageIndexTest, Patch) {
+  std::vector<Package> packages(4);
+  packages[0].set_name("auracle");
+  packages[0].add_maintainers("falconindy");
+  packages[1].set_name("pkgfile");
+  packages[1].add_maintainers("falconindy");
+  packages[1].add_maintainers("dreisner");
+  packages[2].set_name("expac");
+  packages[2].add_maintainers("dreisner");
+  packages[3].set_name("systemd");
+  packages[3].add_maintainers("eworm");
+
+  auto index = PackageIndex::Create(
+      PackageTable({&packages[0], &packages[1], &packages[2]}), "maintainers",
+      PackageIndex::RepeatedFieldIndexingAdapter(&Package::maintainers));
+
+  auto patched =
+      index.Patch({&packages[1]}, {&packages[3]},
+                  PackageTable({&packages[0], &packages[2], &packages[3]}));
+
+  EXPECT_THAT(patched.Get("falconindy"),
+              UnorderedElementsAre(Property(&Package::name, "auracle")));
+  EXPECT_THAT(patched.Get("dreisner"),
+              UnorderedElementsAre(Property(&Package::name, "expac")));
+  EXPECT_THAT(patched.Get("eworm"),
+              UnorderedElementsAre(Property(&Package::name, "systemd")));
+
+  // The original index is unaffected.
+  EXPECT_THAT(index.Get("falconindy"),
+              UnorderedElementsAre(Property(&Package::name, "pkgfile"),
+                                   Property(&Package::name, "auracle")));
+  EXPECT_THAT(index.Get("eworm"), IsEmpty());
+
+  auto repatched = patched.Patch({&packages[2], &packages[3]}, {},
+                                 PackageTable({&packages[0]}));
+  EXPECT_THAT(repatched.Get("dreisner"), IsEmpty());
+  EXPECT_THAT(repatched.Get("eworm"), IsEmpty());
+  EXPECT_THAT(repatched.Get("falconindy"),
+              UnorderedElementsAre(Property(&Package::name, "auracle")));
+}
+
+TEST(PackageIndexTest, ImageRoundTrip) {
+  std::vector<Package> packages(4);
+  packages[0].set_name("auracle");
+  packages[0].add_maintainers("falconindy");
+  packages[1].set_name("pkgfile");
+  packages[1].add_maintainers("falconindy");
+  packages[1].add_maintainers("dreisner");
+  packages[2].set_name("expac");
+  packages[2].add_maintainers("dreisner");
+  packages[3].set_name("systemd");
+  packages[3].add_maintainers("eworm");
+
+  const auto pointers = PackagePointers(packages);
+  auto index = PackageIndex::Create(
+      PackageTable({&packages[0], &packages[1], &packages[2]}), "maintainers",
+      PackageIndex::RepeatedFieldIndexingAdapter(&Package::maintainers));
+  index = index.Patch({&packages[1]}, {&packages[3]}, pointers);
+
+  std::string image;
+  ASSERT_TRUE(index.ToImage(pointers, &image));
+
+  // Images are 8-byte aligned when stored, so copy into storage that is too.
+  auto storage = std::make_shared<std::vector<uint64_t>>(image.size() / 8 + 1);
+  memcpy(storage->data(), image.data(), image.size());
+  const std::string_view view(reinterpret_cast<const char*>(storage->data()),
+                              image.size());
+
+  PackageIndex loaded;
+  ASSERT_TRUE(PackageIndex::FromImage("maintainers", view, storage, pointers,
+                                      &loaded));
+  EXPECT_EQ(loaded.name(), "maintainers");
+
+  EXPECT_THAT(loaded.Get("FalconIndy"),
+              UnorderedElementsAre(Property(&Package::name, "auracle")));
+  EXPECT_THAT(loaded.Get("dreisner"),
+              UnorderedElementsAre(Property(&Package::name, "expac")));
+  EXPECT_THAT(loaded.Get("eworm"),
+              UnorderedElementsAre(Property(&Package::name, "systemd")));
+  EXPECT_THAT(loaded.Get("notfound"), IsEmpty());
+
+  // An image made for a different set of packages is rejected.
+  EXPECT_FALSE(PackageIndex::FromImage(
+      "maintainers", view, storage,
+      PackageTable(std::vector<const Package*>(pointers->begin(),
+                                               pointers->begin() + 2)),
+      &loaded));
+
+  // As is a truncated one.
+  EXPECT_FALSE(PackageIndex::FromImage("maintainers",
+                                       view.substr(0, view.size() - 1),
+                                       storage, pointers, &loaded));
+
+  // As is one whose buckets would send lookups of missing keys around the
+  // table forever.
+  {
+    auto corrupt = std::make_shared<std::vector<uint64_t>>(*storage);
+    char* data = reinterpret_cast<char*>(corrupt->data());
+    uint32_t num_buckets;
+    memcpy(&num_buckets, data + 16, sizeof(num_buckets));
+    for (uint32_t i = 0; i < num_buckets; ++i) {
+      const uint32_t slot = 1;
+      memcpy(data + 32 + i * sizeof(slot), &slot, sizeof(slot));
+    }
+    EXPECT_FALSE(PackageIndex::FromImage("maintainers",
+                                         std::string_view(data, image.size()),
+                                         corrupt, pointers, &loaded));
+  }
+
+  // Packages not in the list can't be represented.
+  EXPECT_FALSE(index.ToImage(PackageTable({pointers->front()}), &image));
+}
+
+TEST(PackageIndexTest, PerfectHash) {
+  std::vector<Package> packages(5000);
+  for (size_t i = 0; i < packages.size(); ++i) {
+    packages[i].set_name(absl::StrCat("package-", i));
+  }
+  const auto pointers = PackagePointers(packages);
+
+  auto index = PackageIndex::Create(
+      pointers, "pkgname",
+      PackageIndex::ScalarFieldIndexingAdapter(&Package::name),
+      /*perfect_hash=*/true);
+
+  auto expect_all_found = [&](const PackageIndex& index) {
+    for (const auto& p : packages) {
+      EXPECT_THAT(index.Get(absl::AsciiStrToUpper(p.name())),
+                  UnorderedElementsAre(Property(&Package::name, p.name())));
+    }
+    EXPECT_THAT(index.Get("package-"), IsEmpty());
+    EXPECT_THAT(index.Get("package-5000"), IsEmpty());
+    EXPECT_THAT(index.Get(""), IsEmpty());
+  };
+  expect_all_found(index);
+
+  std::string image;
+  ASSERT_TRUE(index.ToImage(pointers, &image));
+  auto storage = std::make_shared<std::vector<uint64_t>>(image.size() / 8 + 1);
+  memcpy(storage->data(), image.data(), image.size());
+  const std::string_view view(reinterpret_cast<const char*>(storage->data()),
+                              image.size());
+
+  PackageIndex loaded;
+  ASSERT_TRUE(
+      PackageIndex::FromImage("pkgname", view, storage, pointers, &loaded));
+  expect_all_found(loaded);
+
+  // Patching enough of the index to force the overlay to be folded back in
+  // rebuilds the perfect hash.
+  std::vector<const Package*> changed(pointers->begin(),
+                                      pointers->begin() + 2000);
+  auto patched = index.Patch(changed, changed, pointers);
+  expect_all_found(patched);
+}
+
 }  // namespace
@@ -14,19 +14,34 @@ int Vercmp(const std::string& a, const std::string& b) {
 
 }  // namespace
 
-ParsedDependency::ParsedDependency(std::string_view depstring)
-    : depstring_(depstring) {
-  name_ = depstring;
+// static
+std::string_view ParsedDependency::Name(std::string_view depstring) {
   if (auto pos = depstring.find("<="); pos != depstring.npos) {
-    mod_ = Mod::LE;
-    name_ = depstring.substr(0, pos);
-    version_ = depstring.substr(pos + 2);
+    return depstring.substr(0, pos);
   } else if (auto pos = depstring.find(">="); pos != depstring.npos) {
-    mod_ = Mod::GE;
-    name_ = depstring.substr(0, pos);
-    version_ = depstring.substr(pos + 2);
+    return depstring.substr(0, pos);
   } else if (auto pos = depstring.find_first_of("<>="); pos != depstring.npos) {
-    switch (depstring[pos]) {
+    return depstring.substr(0, pos);
+  }
+
+  return depstring;
+}
+
+ParsedDependency::ParsedDependency(std::string_view depstring)
+    : depstring_(depstring), name_(Name(depstring)) {
+  const std::string_view constraint = depstring.substr(name_.size());
+  if (constraint.empty()) {
+    return;
+  }
+
+  if (constraint.substr(0, 2) == "<=") {
+    mod_ = Mod::LE;
+    version_ = constraint.substr(2);
+  } else if (constraint.substr(0, 2) == ">=") {
+    mod_ = Mod::GE;
+    version_ = constraint.substr(2);
+  } else {
+    switch (constraint[0]) {
       case '<':
         mod_ = Mod::LT;
         break;
@@ -38,10 +53,7 @@ ParsedDependency::ParsedDependency(std::string_view depstring)
         break;
     }
 
-    name_ = depstring.substr(0, pos);
-    version_ = depstring.substr(pos + 1);
-  } else {
-    name_ = depstring;
+    version_ = constraint.substr(1);
   }
 }
 
@@ -74,7 +86,7 @@ bool ParsedDependency::SatisfiedBy(const Package& candidate) const {
 
     // Satisfied via provides without version comparison.
     for (const auto& depstring : candidate.provides()) {
-      if (name_ == ParsedDependency(depstring).name_) {
+      if (name_ == Name(depstring)) {
         return true;
       }
     }
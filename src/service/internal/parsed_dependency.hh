@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 
 #include "aur_internal.pb.h"
 
@@ -21,6 +22,9 @@ class ParsedDependency final {
 
   const std::string& name() const { return name_; }
 
+  // Returns the name portion of |depstring|, without parsing the rest of it.
+  static std::string_view Name(std::string_view depstring);
+
   // Returns true if the given candidate package satisifes the dependency
   // requirement. A dependency is satisfied if:
   //  a) The given |candidate| directly supplies the necessary name and possibly
@@ -45,7 +49,7 @@ class ParsedDependency final {
   std::string depstring_;
   std::string name_;
   std::string version_;
-  Mod mod_;
+  Mod mod_ = Mod::ANY;
 };
 
 }  // namespace aur_internal
@@ -159,4 +159,19 @@ TEST(ParsedDependencyTest, MalformedProvider) {
   EXPECT_FALSE(dep.SatisfiedBy(foo));
 }
 
+TEST(ParsedDependencyTest, Name) {
+  EXPECT_EQ(ParsedDependency::Name("foo"), "foo");
+  EXPECT_EQ(ParsedDependency::Name("foo>=1.0"), "foo");
+  EXPECT_EQ(ParsedDependency::Name("foo<=1.0"), "foo");
+  EXPECT_EQ(ParsedDependency::Name("foo<1.0"), "foo");
+  EXPECT_EQ(ParsedDependency::Name("foo>1.0"), "foo");
+  EXPECT_EQ(ParsedDependency::Name("foo=1.0"), "foo");
+  EXPECT_EQ(ParsedDependency::Name(""), "");
+
+  for (const char* depstring : {"foo", "foo>=1", "foo=1<=2", "a<b>=c"}) {
+    EXPECT_EQ(ParsedDependency::Name(depstring),
+              ParsedDependency(depstring).name());
+  }
+}
+
 }  // namespace
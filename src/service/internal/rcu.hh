@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+namespace aur_internal {
+
+// RcuPointer publishes an immutable value to many concurrent readers, in the
+// style of read-copy-update. Readers pin the current value with Read(), which
+// costs an increment and a decrement of a counter that is, in the common case,
+// private to the reading thread. Writers replace the value with Update(),
+// which waits for every reader that might still be using the old value to
+// finish before destroying it.
+//
+// Readers are tracked in a fixed number of counter slots, which threads are
+// spread across. Each slot has a counter per grace period parity, so that a
+// writer only ever waits on readers that started before it flipped the
+// parity, and a steady stream of new readers can't starve it.
+template <typename T>
+class RcuPointer final {
+ public:
+  class ReadLock final {
+   public:
+    ~ReadLock() { counter_->fetch_sub(1, std::memory_order_release); }
+
+    ReadLock(ReadLock&&) = delete;
+    ReadLock& operator=(ReadLock&&) = delete;
+
+    ReadLock(const ReadLock&) = delete;
+    ReadLock& operator=(const ReadLock&) = delete;
+
+    const T* get() const { return value_; }
+    const T* operator->() const { return value_; }
+    const T& operator*() const { return *value_; }
+
+   private:
+    friend class RcuPointer;
+
+    explicit ReadLock(const RcuPointer& rcu) {
+      const int parity = rcu.parity_.load(std::memory_order_relaxed);
+      counter_ = &rcu.slots_[ThreadSlot()].readers[parity];
+      // Pairs with WaitForReaders(), and must stay seq_cst for that reason.
+      counter_->fetch_add(1, std::memory_order_seq_cst);
+      value_ = rcu.value_.load(std::memory_order_seq_cst);
+    }
+
+    std::atomic<int64_t>* counter_;
+    const T* value_;
+  };
+
+  explicit RcuPointer(std::unique_ptr<const T> value = nullptr)
+      : value_(value.release()) {}
+
+  ~RcuPointer() { delete value_.load(); }
+
+  RcuPointer(RcuPointer&&) = delete;
+  RcuPointer& operator=(RcuPointer&&) = delete;
+
+  RcuPointer(const RcuPointer&) = delete;
+  RcuPointer& operator=(const RcuPointer&) = delete;
+
+  // Pins the current value for the lifetime of the returned lock.
+  ReadLock Read() const { return ReadLock(*this); }
+
+  // Publishes |value| and destroys the previous one once all of its readers
+  // have finished. Callers must serialize calls to Update(), and must not hold
+  // a ReadLock on this pointer while calling it.
+  void Update(std::unique_ptr<const T> value) {
+    const T* previous =
+        value_.exchange(value.release(), std::memory_order_seq_cst);
+
+    // Readers which loaded |previous| are counted under whichever parity they
+    // observed. Flip twice so that both counters are drained.
+    for (int i = 0; i < 2; ++i) {
+      const int parity = parity_.load(std::memory_order_relaxed);
+      parity_.store(1 - parity, std::memory_order_seq_cst);
+      WaitForReaders(parity);
+    }
+
+    delete previous;
+  }
+
+ private:
+  static constexpr size_t kNumSlots = 64;
+
+  struct alignas(64) Slot {
+    std::atomic<int64_t> readers[2] = {};
+  };
+
+  // Spreads threads across slots in the order that they first read.
+  static size_t ThreadSlot() {
+    static std::atomic<size_t> next_slot{0};
+    thread_local const size_t slot =
+        next_slot.fetch_add(1, std::memory_order_relaxed) % kNumSlots;
+    return slot;
+  }
+
+  void WaitForReaders(int parity) const {
+    // Readers increment their counter and then load value_, while Update()
+    // stores value_ and then loads the counters. Only if every one of those
+    // operations is seq_cst is a reader that loaded the old value guaranteed
+    // to have its increment seen here. An acquire load could be satisfied
+    // before the exchange in Update() and miss it.
+    for (const Slot& slot : slots_) {
+      for (int spins = 0;
+           slot.readers[parity].load(std::memory_order_seq_cst) != 0;
+           ++spins) {
+        if (spins < 100) {
+          std::this_thread::yield();
+        } else {
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+      }
+    }
+  }
+
+  std::atomic<const T*> value_;
+  std::atomic<int> parity_{0};
+  mutable Slot slots_[kNumSlots];
+};
+
+}  // namespace aur_internal
@@ -0,0 +1,108 @@
+#include "service/internal/rcu.hh"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using aur_internal::RcuPointer;
+
+namespace {
+
+// Records its own destruction, and whether it was destroyed while a reader
+// was still looking at it.
+struct Tracked {
+  Tracked(int value, std::atomic<int>* destroyed)
+      : value(value), destroyed(destroyed) {}
+  ~Tracked() {
+    alive = false;
+    destroyed->fetch_add(1);
+  }
+
+  int value;
+  std::atomic<bool> alive{true};
+  std::atomic<int>* destroyed;
+};
+
+TEST(RcuPointerTest, ReadsPublishedValue) {
+  std::atomic<int> destroyed{0};
+  RcuPointer<Tracked> rcu(std::make_unique<Tracked>(1, &destroyed));
+
+  {
+    const auto lock = rcu.Read();
+    EXPECT_EQ(lock->value, 1);
+  }
+
+  rcu.Update(std::make_unique<Tracked>(2, &destroyed));
+  EXPECT_EQ(destroyed, 1);
+  EXPECT_EQ(rcu.Read()->value, 2);
+}
+
+TEST(RcuPointerTest, UpdateWaitsForReaders) {
+  std::atomic<int> destroyed{0};
+  RcuPointer<Tracked> rcu(std::make_unique<Tracked>(1, &destroyed));
+
+  std::atomic<bool> reading{false};
+  std::atomic<bool> release{false};
+  std::thread reader([&] {
+    const auto lock = rcu.Read();
+    reading = true;
+    while (!release) {
+      std::this_thread::yield();
+    }
+    EXPECT_TRUE(lock->alive);
+    EXPECT_EQ(lock->value, 1);
+  });
+
+  while (!reading) {
+    std::this_thread::yield();
+  }
+
+  std::thread writer(
+      [&] { rcu.Update(std::make_unique<Tracked>(2, &destroyed)); });
+
+  // New readers see the new value while the old reader holds on.
+  while (rcu.Read()->value != 2) {
+    std::this_thread::yield();
+  }
+  EXPECT_EQ(destroyed, 0);
+
+  release = true;
+  reader.join();
+  writer.join();
+  EXPECT_EQ(destroyed, 1);
+}
+
+TEST(RcuPointerTest, ConcurrentReadersAndUpdates) {
+  std::atomic<int> destroyed{0};
+  RcuPointer<Tracked> rcu(std::make_unique<Tracked>(0, &destroyed));
+
+  std::atomic<bool> done{false};
+  std::vector<std::thread> readers;
+  for (int i = 0; i < 4; ++i) {
+    readers.emplace_back([&] {
+      int last = 0;
+      while (!done) {
+        const auto lock = rcu.Read();
+        ASSERT_TRUE(lock->alive);
+        ASSERT_GE(lock->value, last);
+        last = lock->value;
+      }
+    });
+  }
+
+  for (int i = 1; i <= 100; ++i) {
+    rcu.Update(std::make_unique<Tracked>(i, &destroyed));
+  }
+
+  done = true;
+  for (auto& reader : readers) {
+    reader.join();
+  }
+
+  EXPECT_EQ(destroyed, 100);
+}
+
+}  // namespace
@@ -0,0 +1,371 @@
+#include "service/internal/search_index.hh"
+
+#include <algorithm>
+
+#include "absl/algorithm/container.h"
+#include "service/internal/ascii.hh"
+
+namespace aur_internal {
+
+namespace {
+
+uint32_t Trigram(const char* p) {
+  return uint32_t{static_cast<unsigned char>(p[0])} << 16 |
+         uint32_t{static_cast<unsigned char>(p[1])} << 8 |
+         uint32_t{static_cast<unsigned char>(p[2])};
+}
+
+// The literal text that a glob pattern requires of any subject it matches,
+// lowercased.
+struct GlobLiterals {
+  // The text that a subject must begin with. May be empty.
+  std::string prefix;
+
+  // Runs of text that a subject must contain somewhere, including the prefix.
+  std::vector<std::string> runs;
+};
+
+// Splits |pattern| into literal runs at every character with a special
+// meaning to fnmatch. Bracket expressions and escapes are skipped over rather
+// than interpreted, which only ever loses literal text and so never excludes
+// a real match.
+GlobLiterals ParseGlob(std::string_view pattern) {
+  GlobLiterals literals;
+
+  std::string run;
+  bool anchored = true;
+  auto end_run = [&] {
+    if (anchored) {
+      literals.prefix = run;
+      anchored = false;
+    }
+    if (!run.empty()) {
+      literals.runs.push_back(std::move(run));
+      run.clear();
+    }
+  };
+
+  for (size_t i = 0; i < pattern.size(); ++i) {
+    switch (pattern[i]) {
+      case '*':
+      case '?':
+        end_run();
+        break;
+      case '\\':
+        end_run();
+        ++i;
+        break;
+      case '[': {
+        end_run();
+        // A ']' directly after the opening bracket, or after its negation,
+        // is part of the expression.
+        size_t close = i + 1;
+        if (close < pattern.size() &&
+            (pattern[close] == '!' || pattern[close] == '^')) {
+          ++close;
+        }
+        close = pattern.find(']', close + 1);
+        i = close == pattern.npos ? pattern.size() : close;
+        break;
+      }
+      default:
+        run.push_back(AsciiToLower(pattern[i]));
+        break;
+    }
+  }
+  end_run();
+
+  return literals;
+}
+
+}  // namespace
+
+std::pair<const uint32_t*, const uint32_t*> SearchIndex::Trigrams::postings(
+    uint32_t trigram) const {
+  auto iter = ids.find(trigram);
+  if (iter == ids.end()) {
+    return {nullptr, nullptr};
+  }
+
+  const uint32_t id = iter->second;
+  return {positions.data() + offsets[id], positions.data() + offsets[id + 1]};
+}
+
+// static
+SearchIndex SearchIndex::Build(const std::vector<const Package*>& packages) {
+  SearchIndex index;
+  index.names_ = BuildField(packages, &Package::name);
+  index.descriptions_ = BuildField(packages, &Package::description);
+  return index;
+}
+
+// static
+SearchIndex::FieldIndex SearchIndex::BuildField(
+    const std::vector<const Package*>& packages,
+    const std::string& (Package::*field)() const) {
+  FieldIndex index;
+
+  Values& values = index.values;
+  values.offsets.reserve(packages.size() + 1);
+  values.offsets.push_back(0);
+  for (const Package* package : packages) {
+    const std::string& value = (package->*field)();
+    values.bytes.append(value);
+    values.offsets.push_back(values.bytes.size());
+  }
+  AsciiToLower(values.bytes.data(), values.bytes.size(), values.bytes.data());
+
+  auto value = [&](uint32_t i) { return values.value(i); };
+
+  // Sorted values.
+  std::vector<uint32_t> order(packages.size());
+  for (uint32_t i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    return value(a) < value(b);
+  });
+
+  SortedValues& sorted = index.sorted;
+  sorted.values.bytes.reserve(values.bytes.size());
+  sorted.values.offsets.reserve(values.offsets.size());
+  sorted.values.offsets.push_back(0);
+  sorted.positions = std::move(order);
+  for (uint32_t position : sorted.positions) {
+    sorted.values.bytes.append(value(position));
+    sorted.values.offsets.push_back(sorted.values.bytes.size());
+  }
+
+  // Trigram postings. Packages are visited in order, so a counting sort of
+  // the (trigram, package) pairs by trigram leaves every posting list sorted.
+  Trigrams& trigrams = index.trigrams;
+  std::vector<std::pair<uint32_t, uint32_t>> entries;
+  std::vector<uint32_t> package_ids;
+  for (uint32_t position = 0; position < packages.size(); ++position) {
+    const std::string_view v = value(position);
+
+    package_ids.clear();
+    for (size_t i = 0; i + 3 <= v.size(); ++i) {
+      auto [iter, inserted] =
+          trigrams.ids.try_emplace(Trigram(&v[i]), trigrams.ids.size());
+      package_ids.push_back(iter->second);
+    }
+    std::sort(package_ids.begin(), package_ids.end());
+    package_ids.erase(std::unique(package_ids.begin(), package_ids.end()),
+                      package_ids.end());
+
+    for (uint32_t id : package_ids) {
+      entries.emplace_back(id, position);
+    }
+  }
+
+  trigrams.offsets.assign(trigrams.ids.size() + 1, 0);
+  for (const auto& [id, position] : entries) {
+    ++trigrams.offsets[id + 1];
+  }
+  for (size_t i = 1; i < trigrams.offsets.size(); ++i) {
+    trigrams.offsets[i] += trigrams.offsets[i - 1];
+  }
+
+  trigrams.positions.resize(entries.size());
+  std::vector<uint32_t> next(trigrams.offsets.begin(),
+                             trigrams.offsets.end() - 1);
+  for (const auto& [id, position] : entries) {
+    trigrams.positions[next[id]++] = position;
+  }
+
+  return index;
+}
+
+SearchIndex::Lookup SearchIndex::FindStructures(
+    const FieldIndex& index, std::string_view pattern) {
+  const GlobLiterals literals = ParseGlob(pattern);
+  Lookup lookup;
+
+  // The range of sorted values beginning with the prefix.
+  lookup.has_prefix = !literals.prefix.empty();
+  if (lookup.has_prefix) {
+    const SortedValues& sorted = index.sorted;
+    const std::string_view prefix = literals.prefix;
+    auto head = [&](size_t i) {
+      return sorted.value(i).substr(0, prefix.size());
+    };
+
+    size_t lo = 0, hi = sorted.size();
+    while (lo < hi) {
+      const size_t mid = lo + (hi - lo) / 2;
+      if (head(mid) < prefix) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    lookup.prefix_begin = lo;
+
+    hi = sorted.size();
+    while (lo < hi) {
+      const size_t mid = lo + (hi - lo) / 2;
+      if (head(mid) == prefix) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    lookup.prefix_end = lo;
+  }
+
+  // Postings for every distinct trigram required by the pattern.
+  std::vector<uint32_t> seen;
+  for (const std::string& run : literals.runs) {
+    for (size_t i = 0; i + 3 <= run.size(); ++i) {
+      const uint32_t trigram = Trigram(&run[i]);
+      if (absl::c_linear_search(seen, trigram)) {
+        continue;
+      }
+      seen.push_back(trigram);
+      lookup.postings.push_back(index.trigrams.postings(trigram));
+    }
+  }
+  std::sort(lookup.postings.begin(), lookup.postings.end(),
+            [](const Range& a, const Range& b) {
+              return a.second - a.first < b.second - b.first;
+            });
+
+  return lookup;
+}
+
+size_t SearchIndex::EstimateCandidates(Field field,
+                                       std::string_view pattern) const {
+  const FieldIndex& index = field_index(field);
+  const Lookup lookup = FindStructures(index, pattern);
+
+  size_t estimate = index.sorted.size();
+  if (lookup.has_prefix) {
+    estimate = lookup.prefix_end - lookup.prefix_begin;
+  }
+  if (!lookup.postings.empty()) {
+    const Range& shortest = lookup.postings[0];
+    estimate = std::min<size_t>(estimate, shortest.second - shortest.first);
+  }
+  return estimate;
+}
+
+bool SearchIndex::Candidates(Field field, std::string_view pattern,
+                             std::vector<uint32_t>* candidates) const {
+  const FieldIndex& index = field_index(field);
+  const Lookup lookup = FindStructures(index, pattern);
+  const bool has_prefix = lookup.has_prefix;
+  const std::vector<Range>& postings = lookup.postings;
+
+  if (!has_prefix && postings.empty()) {
+    return false;
+  }
+
+  if (has_prefix &&
+      (postings.empty() ||
+       lookup.prefix_end - lookup.prefix_begin <=
+           static_cast<size_t>(postings[0].second - postings[0].first))) {
+    candidates->insert(candidates->end(),
+                       index.sorted.positions.begin() + lookup.prefix_begin,
+                       index.sorted.positions.begin() + lookup.prefix_end);
+    return true;
+  }
+
+  // Intersect, starting from the shortest list.
+  std::vector<uint32_t> result(postings[0].first, postings[0].second);
+  for (size_t i = 1; i < postings.size() && !result.empty(); ++i) {
+    const uint32_t* begin = postings[i].first;
+    const uint32_t* const end = postings[i].second;
+    size_t kept = 0;
+    for (uint32_t position : result) {
+      begin = std::lower_bound(begin, end, position);
+      if (begin != end && *begin == position) {
+        result[kept++] = position;
+      }
+    }
+    result.resize(kept);
+  }
+
+  candidates->insert(candidates->end(), result.begin(), result.end());
+  return true;
+}
+
+void SearchIndex::FindSimilar(Field field, std::string_view term,
+                              uint32_t max_edits,
+                              std::vector<Similar>* matches) const {
+  const SortedValues& sorted = field_index(field).sorted;
+  std::string target(term);
+  AsciiToLower(target.data(), target.size(), target.data());
+
+  // The state of the automaton after d bytes of a value is row d of the
+  // usual edit distance table: the distances between those d bytes and each
+  // prefix of |target|. Rows are kept for the prefix of |path| that's been
+  // walked, and only those past the prefix it shares with the next value need
+  // to be computed again.
+  const size_t width = target.size() + 1;
+  std::vector<uint32_t> rows(width);
+  for (size_t j = 0; j < width; ++j) {
+    rows[j] = j;
+  }
+  std::string_view path;
+  size_t depth = 0;
+
+  for (size_t i = 0; i < sorted.size();) {
+    const std::string_view value = sorted.value(i);
+
+    size_t shared = 0;
+    const size_t max_shared = std::min(depth, value.size());
+    while (shared < max_shared && path[shared] == value[shared]) {
+      ++shared;
+    }
+    path = value;
+    depth = shared;
+
+    bool rejected = false;
+    while (depth < value.size()) {
+      rows.resize((depth + 2) * width);
+      const uint32_t* prev = &rows[depth * width];
+      uint32_t* row = &rows[(depth + 1) * width];
+
+      row[0] = depth + 1;
+      uint32_t best = row[0];
+      for (size_t j = 1; j < width; ++j) {
+        row[j] = std::min({prev[j] + 1, row[j - 1] + 1,
+                           prev[j - 1] + (value[depth] != target[j - 1])});
+        best = std::min(best, row[j]);
+      }
+      ++depth;
+
+      // Distances never shrink as a value grows, so no value beginning with
+      // this prefix can be accepted.
+      if (best > max_edits) {
+        rejected = true;
+        break;
+      }
+    }
+
+    if (!rejected) {
+      const uint32_t distance = rows[depth * width + target.size()];
+      if (distance <= max_edits) {
+        matches->push_back({sorted.positions[i], distance});
+      }
+      ++i;
+      continue;
+    }
+
+    // Skip past every value beginning with the rejected prefix.
+    const std::string_view prefix = value.substr(0, depth);
+    size_t lo = i + 1, hi = sorted.size();
+    while (lo < hi) {
+      const size_t mid = lo + (hi - lo) / 2;
+      if (sorted.value(mid).substr(0, prefix.size()) == prefix) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    i = lo;
+  }
+}
+
+}  // namespace aur_internal
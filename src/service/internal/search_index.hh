@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "aur_internal.pb.h"
+
+namespace aur_internal {
+
+// SearchIndex narrows down the packages that a search term could match, so
+// that searches don't have to test every package in a snapshot. Packages are
+// identified by their position in the list that the index was built from.
+//
+// Search terms are shell-like globs, matched case-insensitively, and the
+// index only ever produces candidates: every package that matches a term is
+// among its candidates, but candidates must still be checked against the
+// term.
+//
+// Every field's lowercased values are also kept in package order, packed into
+// a single buffer, so that the terms which remain can be checked against
+// contiguous text rather than against each package.
+//
+// Two structures are kept per field for narrowing. Sorted values answer terms
+// with a literal prefix, like "python-*", with a single contiguous range.
+// Trigram postings answer terms containing literal text anywhere, like "*-git"
+// or "*firefox*": a subject can only match if it contains every trigram of
+// every literal run in the term, so the candidates are the intersection of
+// those trigrams' postings.
+//
+// Sorted values also serve as a trie for fuzzy matching. Values within a few
+// edits of a term are found by running a Levenshtein automaton for the term
+// over the trie, abandoning every value that shares a prefix as soon as the
+// automaton rejects that prefix.
+class SearchIndex final {
+ public:
+  enum class Field {
+    kName,
+    kDescription,
+  };
+
+  SearchIndex() = default;
+
+  static SearchIndex Build(const std::vector<const Package*>& packages);
+
+  SearchIndex(SearchIndex&&) = default;
+  SearchIndex& operator=(SearchIndex&&) = default;
+
+  SearchIndex(const SearchIndex&) = delete;
+  SearchIndex& operator=(const SearchIndex&) = delete;
+
+  // Appends the positions of packages whose |field| might match the glob
+  // |pattern| to |candidates|, in no particular order. Returns false, leaving
+  // |candidates| untouched, if the index can't rule out any package. Of the
+  // structures that apply to |pattern|, the one expected to produce the
+  // fewest candidates is used.
+  bool Candidates(Field field, std::string_view pattern,
+                  std::vector<uint32_t>* candidates) const;
+
+  // Returns an upper bound on the number of candidates that Candidates()
+  // would produce for |pattern| in |field|, or the number of packages if the
+  // index can't rule out any. Only the sizes of the structures involved are
+  // looked at, so this is much cheaper than collecting the candidates.
+  size_t EstimateCandidates(Field field, std::string_view pattern) const;
+
+  struct Similar {
+    uint32_t position;
+    uint32_t distance;
+  };
+
+  // Appends the packages whose |field| is within |max_edits| insertions,
+  // deletions or substitutions of bytes of |term|, ignoring case, to
+  // |matches|, in no particular order. Each match carries its edit distance.
+  void FindSimilar(Field field, std::string_view term, uint32_t max_edits,
+                   std::vector<Similar>* matches) const;
+
+  // Returns the lowercased |field| of the package at |position|.
+  std::string_view Value(Field field, uint32_t position) const {
+    return field_index(field).values.value(position);
+  }
+
+ private:
+  // Lowercased values of a field, concatenated into one buffer. The i-th value
+  // spans [offsets[i], offsets[i + 1]).
+  struct Values {
+    std::string bytes;
+    std::vector<uint32_t> offsets;
+
+    std::string_view value(size_t i) const {
+      return std::string_view(bytes.data() + offsets[i],
+                              offsets[i + 1] - offsets[i]);
+    }
+  };
+
+  // The lowercased values of a field in sorted order, so that all values
+  // sharing a prefix are found in a single contiguous range.
+  struct SortedValues {
+    Values values;
+    std::vector<uint32_t> positions;
+
+    size_t size() const { return positions.size(); }
+    std::string_view value(size_t i) const { return values.value(i); }
+  };
+
+  // Postings of package positions for every trigram of the lowercased values
+  // of a field. Each package is listed at most once per trigram, in ascending
+  // order.
+  struct Trigrams {
+    absl::flat_hash_map<uint32_t, uint32_t> ids;
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> positions;
+
+    // Returns the postings of |trigram|, or an empty range if no value
+    // contains it.
+    std::pair<const uint32_t*, const uint32_t*> postings(
+        uint32_t trigram) const;
+  };
+
+  struct FieldIndex {
+    // In package order.
+    Values values;
+    SortedValues sorted;
+    Trigrams trigrams;
+  };
+
+  using Range = std::pair<const uint32_t*, const uint32_t*>;
+
+  // The structures of a field that apply to a pattern.
+  struct Lookup {
+    // The range of sorted values beginning with the pattern's literal prefix,
+    // if it has one.
+    bool has_prefix = false;
+    size_t prefix_begin = 0;
+    size_t prefix_end = 0;
+
+    // Postings of every distinct trigram the pattern requires, shortest
+    // first.
+    std::vector<Range> postings;
+  };
+
+  static Lookup FindStructures(const FieldIndex& index,
+                               std::string_view pattern);
+
+  static FieldIndex BuildField(const std::vector<const Package*>& packages,
+                               const std::string& (Package::*field)() const);
+
+  const FieldIndex& field_index(Field field) const {
+    return field == Field::kName ? names_ : descriptions_;
+  }
+
+  FieldIndex names_;
+  FieldIndex descriptions_;
+};
+
+}  // namespace aur_internal
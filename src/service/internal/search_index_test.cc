@@ -0,0 +1,234 @@
+#include "service/internal/search_index.hh"
+
+#include <fnmatch.h>
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "aur_internal.pb.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using aur_internal::Package;
+using aur_internal::SearchIndex;
+using testing::IsSupersetOf;
+using testing::Pair;
+using testing::UnorderedElementsAre;
+using testing::UnorderedElementsAreArray;
+
+namespace {
+
+class SearchIndexTest : public testing::Test {
+ protected:
+  SearchIndexTest() {
+    for (const auto& [name, description] :
+         std::vector<std::pair<std::string, std::string>>{
+             {"python-requests", "Python HTTP for Humans"},
+             {"python2-requests", "Python HTTP for Humans (legacy)"},
+             {"Python-Attrs", "Classes without boilerplate"},
+             {"pacman-git", "A library-based package manager"},
+             {"expac", "pacman database extraction utility"},
+             {"py", ""},
+         }) {
+      auto& p = packages_.emplace_back();
+      p.set_name(name);
+      p.set_description(description);
+    }
+
+    for (const auto& p : packages_) {
+      pointers_.push_back(&p);
+    }
+    index_ = SearchIndex::Build(pointers_);
+  }
+
+  // Returns the positions of packages whose |field| matches |pattern|
+  // according to fnmatch.
+  std::vector<uint32_t> Matches(SearchIndex::Field field,
+                                const std::string& pattern) const {
+    std::vector<uint32_t> matches;
+    for (uint32_t i = 0; i < packages_.size(); ++i) {
+      const std::string& subject = field == SearchIndex::Field::kName
+                                       ? packages_[i].name()
+                                       : packages_[i].description();
+      if (fnmatch(pattern.c_str(), subject.c_str(), FNM_CASEFOLD) == 0) {
+        matches.push_back(i);
+      }
+    }
+    return matches;
+  }
+
+  std::vector<Package> packages_;
+  std::vector<const Package*> pointers_;
+  SearchIndex index_;
+};
+
+TEST_F(SearchIndexTest, ValuesAreLowercasedInPackageOrder) {
+  EXPECT_EQ(index_.Value(SearchIndex::Field::kName, 2), "python-attrs");
+  EXPECT_EQ(index_.Value(SearchIndex::Field::kDescription, 0),
+            "python http for humans");
+  EXPECT_EQ(index_.Value(SearchIndex::Field::kDescription, 5), "");
+
+  for (uint32_t i = 0; i < packages_.size(); ++i) {
+    EXPECT_EQ(index_.Value(SearchIndex::Field::kName, i).size(),
+              packages_[i].name().size());
+  }
+}
+
+TEST_F(SearchIndexTest, PrefixCandidates) {
+  std::vector<uint32_t> candidates;
+  ASSERT_TRUE(index_.Candidates(SearchIndex::Field::kName, "PYTHON-*",
+                                &candidates));
+  EXPECT_THAT(candidates, UnorderedElementsAre(0, 2));
+
+  candidates.clear();
+  ASSERT_TRUE(index_.Candidates(SearchIndex::Field::kDescription, "pacman*",
+                                &candidates));
+  EXPECT_THAT(candidates, UnorderedElementsAre(4));
+
+  candidates.clear();
+  ASSERT_TRUE(index_.Candidates(SearchIndex::Field::kName, "zzz*",
+                                &candidates));
+  EXPECT_THAT(candidates, testing::IsEmpty());
+}
+
+TEST_F(SearchIndexTest, InfixCandidates) {
+  std::vector<uint32_t> candidates;
+  ASSERT_TRUE(
+      index_.Candidates(SearchIndex::Field::kName, "*-GIT", &candidates));
+  EXPECT_THAT(candidates, UnorderedElementsAre(3));
+
+  candidates.clear();
+  ASSERT_TRUE(index_.Candidates(SearchIndex::Field::kDescription,
+                                "*http*humans*", &candidates));
+  EXPECT_THAT(candidates, UnorderedElementsAre(0, 1));
+
+  candidates.clear();
+  ASSERT_TRUE(index_.Candidates(SearchIndex::Field::kName, "*requests",
+                                &candidates));
+  EXPECT_THAT(candidates, UnorderedElementsAre(0, 1));
+
+  // A trigram that appears nowhere rules out everything.
+  candidates.clear();
+  ASSERT_TRUE(
+      index_.Candidates(SearchIndex::Field::kName, "*xyz*", &candidates));
+  EXPECT_THAT(candidates, testing::IsEmpty());
+}
+
+TEST_F(SearchIndexTest, PatternsWithoutLiteralsAreNotNarrowed) {
+  std::vector<uint32_t> candidates{42};
+  for (const char* pattern : {"*", "?y*", "*[p]a*", "\\py*", "*py?", ""}) {
+    EXPECT_FALSE(
+        index_.Candidates(SearchIndex::Field::kName, pattern, &candidates))
+        << pattern;
+  }
+  EXPECT_THAT(candidates, UnorderedElementsAre(42));
+}
+
+TEST_F(SearchIndexTest, EstimatesBoundCandidates) {
+  EXPECT_EQ(index_.EstimateCandidates(SearchIndex::Field::kName, "PYTHON-*"),
+            2);
+  EXPECT_EQ(index_.EstimateCandidates(SearchIndex::Field::kName, "*xyz*"), 0);
+  EXPECT_EQ(index_.EstimateCandidates(SearchIndex::Field::kName, "*"),
+            packages_.size());
+
+  for (SearchIndex::Field field :
+       {SearchIndex::Field::kName, SearchIndex::Field::kDescription}) {
+    for (const char* pattern :
+         {"py*", "python*requests", "pac*git", "*-git", "*http*humans*",
+          "*requests", "*ma?ager", "*[p]a*", "?y*"}) {
+      std::vector<uint32_t> candidates;
+      if (index_.Candidates(field, pattern, &candidates)) {
+        EXPECT_LE(candidates.size(), index_.EstimateCandidates(field, pattern))
+            << pattern;
+      } else {
+        EXPECT_EQ(index_.EstimateCandidates(field, pattern), packages_.size())
+            << pattern;
+      }
+    }
+  }
+}
+
+TEST_F(SearchIndexTest, CandidatesIncludeAllMatches) {
+  for (SearchIndex::Field field :
+       {SearchIndex::Field::kName, SearchIndex::Field::kDescription}) {
+    for (const char* pattern :
+         {"py", "py*", "python*requests", "Python?*", "pac*git", "a*",
+          "pacman-git", "python[2-]*", "classes w*", "*-git", "*http*",
+          "*for humans*", "*(legacy)", "*[]]egacy*", "*[!x]legacy*",
+          "*\\(legacy*", "*ma?ager", "*with*out*"}) {
+      std::vector<uint32_t> candidates;
+      if (index_.Candidates(field, pattern, &candidates)) {
+        EXPECT_THAT(candidates, IsSupersetOf(Matches(field, pattern)))
+            << pattern;
+      }
+    }
+  }
+}
+
+TEST_F(SearchIndexTest, FindSimilar) {
+  auto similar = [&](std::string_view term, uint32_t max_edits) {
+    std::vector<SearchIndex::Similar> matches;
+    index_.FindSimilar(SearchIndex::Field::kName, term, max_edits, &matches);
+    std::vector<std::pair<uint32_t, uint32_t>> result;
+    for (const auto& match : matches) {
+      result.emplace_back(match.position, match.distance);
+    }
+    return result;
+  };
+
+  EXPECT_THAT(similar("Pacman-Git", 0), UnorderedElementsAre(Pair(3, 0)));
+  EXPECT_THAT(similar("pacman-gti", 2), UnorderedElementsAre(Pair(3, 2)));
+  EXPECT_THAT(similar("python-request", 2),
+              UnorderedElementsAre(Pair(0, 1), Pair(1, 2)));
+  EXPECT_THAT(similar("ex", 1), testing::IsEmpty());
+  EXPECT_THAT(similar("", 2), UnorderedElementsAre(Pair(5, 2)));
+}
+
+TEST_F(SearchIndexTest, FindSimilarAgreesWithEditDistance) {
+  auto edit_distance = [](std::string_view a, std::string_view b) {
+    std::vector<uint32_t> row(b.size() + 1);
+    for (size_t j = 0; j < row.size(); ++j) {
+      row[j] = j;
+    }
+    for (size_t i = 1; i <= a.size(); ++i) {
+      uint32_t diagonal = row[0];
+      row[0] = i;
+      for (size_t j = 1; j <= b.size(); ++j) {
+        const uint32_t above = row[j];
+        row[j] = std::min({row[j] + 1, row[j - 1] + 1,
+                           diagonal + (a[i - 1] != b[j - 1])});
+        diagonal = above;
+      }
+    }
+    return row.back();
+  };
+
+  for (const char* term : {"python", "pyhton-requests", "pacman", "expac-git",
+                           "p", "python3-attrs", "xyz"}) {
+    for (uint32_t max_edits = 0; max_edits < 4; ++max_edits) {
+      std::vector<std::pair<uint32_t, uint32_t>> expected;
+      for (uint32_t i = 0; i < packages_.size(); ++i) {
+        const uint32_t distance = edit_distance(
+            term, index_.Value(SearchIndex::Field::kName, i));
+        if (distance <= max_edits) {
+          expected.emplace_back(i, distance);
+        }
+      }
+
+      std::vector<SearchIndex::Similar> matches;
+      index_.FindSimilar(SearchIndex::Field::kName, term, max_edits,
+                         &matches);
+      std::vector<std::pair<uint32_t, uint32_t>> result;
+      for (const auto& match : matches) {
+        result.emplace_back(match.position, match.distance);
+      }
+      EXPECT_THAT(result, UnorderedElementsAreArray(expected))
+          << term << " " << max_edits;
+    }
+  }
+}
+
+}  // namespace
@@ -1,14 +1,24 @@
 #include "service/internal/service_impl.hh"
 
-#include <fnmatch.h>
-
+#include <algorithm>
+#include <atomic>
+#include <functional>
 #include <iostream>
+#include <iterator>
 
 #include "absl/algorithm/container.h"
+#include "absl/strings/escaping.h"
 #include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/synchronization/mutex.h"
 #include "absl/time/time.h"
 #include "google/protobuf/util/field_mask_util.h"
+#include "service/internal/glob.hh"
 #include "service/internal/parsed_dependency.hh"
+#include "storage/packed_storage.hh"
+#include "util/parallel.hh"
 
 using google::protobuf::RepeatedPtrFieldBackInserter;
 using google::protobuf::util::FieldMaskUtil;
@@ -69,40 +79,230 @@ void LookupByIndex(const PackageIndex& index, const LookupRequest& request,
                                         response->mutable_packages()));
 }
 
-bool PatternMatch(const std::string& pattern, const std::string& subject) {
-  return fnmatch(pattern.c_str(), subject.c_str(), FNM_CASEFOLD) == 0;
+// Reads and parses the packages stored at |keys| into |packages|, parsing
+// directly out of the storage when it supports zero-copy reads and otherwise
+// reading all of the keys in a single batch. Returns true for each package
+// that was loaded.
+std::vector<bool> ReadPackages(const aur_storage::Storage* storage,
+                               const std::vector<std::string>& keys,
+                               const std::vector<Package*>& packages) {
+  std::vector<bool> loaded(keys.size());
+
+  std::vector<size_t> unviewable;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    std::string_view view;
+    if (storage->GetView(keys[i], &view)) {
+      loaded[i] = packages[i]->ParseFromArray(view.data(), view.size());
+    } else {
+      unviewable.push_back(i);
+    }
+  }
+
+  if (unviewable.empty()) {
+    return loaded;
+  }
+
+  std::vector<std::string> batch_keys;
+  batch_keys.reserve(unviewable.size());
+  for (size_t i : unviewable) {
+    batch_keys.push_back(keys[i]);
+  }
+
+  std::vector<std::string> values;
+  const auto found = storage->MultiGet(batch_keys, &values);
+  for (size_t j = 0; j < unviewable.size(); ++j) {
+    const size_t i = unviewable[j];
+    loaded[i] = found[j] && packages[i]->ParseFromString(values[j]);
+  }
+
+  return loaded;
+}
+
+using PositionOrder = std::function<bool(uint32_t, uint32_t)>;
+
+// Orders package positions by a numeric field, highest first, and then by
+// position.
+template <typename T>
+PositionOrder DescendingOrder(const std::vector<const Package*>& packages,
+                              T (Package::*field)() const) {
+  return [&packages, field](uint32_t a, uint32_t b) {
+    const T value_a = (packages[a]->*field)();
+    const T value_b = (packages[b]->*field)();
+    return value_a != value_b ? value_a > value_b : a < b;
+  };
+}
+
+// Selects the first |limit| of the package positions offered to it, under
+// |order| or, if |order| is empty, in the order they were offered. Only the
+// selected positions are held, and the rest are just counted.
+class TopPositions final {
+ public:
+  TopPositions(size_t limit, const PositionOrder& order)
+      : limit_(limit), order_(&order) {}
+
+  void Offer(uint32_t position) {
+    ++count_;
+    Keep(position);
+  }
+
+  // Offers everything selected by |other|. Without an order, |other| must
+  // have been offered positions which come after those offered here.
+  void Merge(const TopPositions& other) {
+    count_ += other.count_;
+    for (uint32_t position : other.positions_) {
+      Keep(position);
+    }
+  }
+
+  // True if further offers can't change the selection, and the count is
+  // already known to exceed the limit.
+  bool done() const { return !*order_ && count_ > limit_; }
+
+  size_t count() const { return count_; }
+
+  // Returns the selected positions, in order.
+  std::vector<uint32_t> Take() {
+    if (*order_) {
+      std::sort_heap(positions_.begin(), positions_.end(), *order_);
+    }
+    return std::move(positions_);
+  }
+
+ private:
+  // With an order, the selection is a heap whose top is the last of the
+  // selected positions.
+  void Keep(uint32_t position) {
+    if (positions_.size() < limit_) {
+      positions_.push_back(position);
+      if (*order_) {
+        std::push_heap(positions_.begin(), positions_.end(), *order_);
+      }
+    } else if (*order_ && (*order_)(position, positions_.front())) {
+      std::pop_heap(positions_.begin(), positions_.end(), *order_);
+      positions_.back() = position;
+      std::push_heap(positions_.begin(), positions_.end(), *order_);
+    }
+  }
+
+  size_t limit_;
+  const PositionOrder* order_;
+  size_t count_ = 0;
+  std::vector<uint32_t> positions_;
+};
+
+// Page tokens carry the generation of the snapshot they were issued for, a
+// fingerprint of the search, and the number of results already returned.
+uint64_t SearchFingerprint(const SearchRequest& request) {
+  SearchRequest search = request;
+  search.clear_options();
+  search.clear_page_size();
+  search.clear_page_token();
+  if (search.order_by() == SearchRequest::ORDERBY_UNKNOWN) {
+    search.set_order_by(SearchRequest::ORDERBY_RELEVANCE);
+  }
+  return std::hash<std::string>()(search.SerializeAsString());
+}
+
+std::string EncodePageToken(const SearchRequest& request, uint64_t generation,
+                            size_t offset) {
+  return absl::WebSafeBase64Escape(absl::StrCat(
+      generation, ":", SearchFingerprint(request), ":", offset));
 }
 
-bool SearchOneName(const Package& package, const std::string& term) {
-  return PatternMatch(term, package.name());
+bool DecodePageToken(const SearchRequest& request, uint64_t* generation,
+                     size_t* offset) {
+  std::string token;
+  if (!absl::WebSafeBase64Unescape(request.page_token(), &token)) {
+    return false;
+  }
+
+  const std::vector<std::string> parts = absl::StrSplit(token, ':');
+  uint64_t fingerprint;
+  return parts.size() == 3 && absl::SimpleAtoi(parts[0], generation) &&
+         absl::SimpleAtoi(parts[1], &fingerprint) &&
+         fingerprint == SearchFingerprint(request) &&
+         absl::SimpleAtoi(parts[2], offset);
 }
 
-bool SearchOneDesc(const Package& package, const std::string& term) {
-  return PatternMatch(term, package.description());
+// Snapshot generations start from the clock, so that page tokens issued by an
+// earlier process aren't mistaken for current ones.
+uint64_t NextGeneration() {
+  static std::atomic<uint64_t> next(absl::ToUnixNanos(absl::Now()));
+  return next.fetch_add(1, std::memory_order_relaxed);
 }
 
-bool SearchOneNameDesc(const Package& package, const std::string& term) {
-  return SearchOneName(package, term) || SearchOneDesc(package, term);
+using RepeatedStringField =
+    const google::protobuf::RepeatedPtrField<std::string>& (Package::*)()
+        const;
+
+// Index builders for kIndexDefinitions, specialized on the field they index.
+template <const std::string& (Package::*kField)() const,
+          bool kPerfectHash = false>
+PackageIndex ScalarFieldIndex(
+    std::shared_ptr<const std::vector<const Package*>> packages,
+    const std::string& name) {
+  return PackageIndex::Create(std::move(packages), name,
+                              PackageIndex::ScalarFieldIndexingAdapter(kField),
+                              kPerfectHash);
+}
+
+template <RepeatedStringField kField, bool kSynthesizeEmpty = false>
+PackageIndex RepeatedFieldIndex(
+    std::shared_ptr<const std::vector<const Package*>> packages,
+    const std::string& name) {
+  return PackageIndex::Create(
+      std::move(packages), name,
+      PackageIndex::RepeatedFieldIndexingAdapter(kField, kSynthesizeEmpty));
+}
+
+template <RepeatedStringField kField>
+PackageIndex DepstringFieldIndex(
+    std::shared_ptr<const std::vector<const Package*>> packages,
+    const std::string& name) {
+  return PackageIndex::Create(
+      std::move(packages), name,
+      PackageIndex::DepstringFieldIndexingAdapter(kField));
 }
 
 }  // namespace
 
 ServiceImpl::ServiceImpl(const aur_storage::Storage* storage)
-    : storage_(storage) {
+    : ServiceImpl(storage, Options()) {}
+
+ServiceImpl::ServiceImpl(const aur_storage::Storage* storage, Options options)
+    : storage_(storage), options_(std::move(options)) {
+  int search_threads = options_.search_threads;
+  if (search_threads <= 0) {
+    search_threads = std::max(1, aur_util::ResolveThreadCount(0) / 2);
+  }
+  search_pool_ = std::make_unique<ThreadPool>(search_threads);
+
   Reload();
 }
 
 static absl::Mutex reload_mu_{absl::kConstInit};
 
 void ServiceImpl::Reload() {
-  std::shared_ptr<const InMemoryDB> db;
+  absl::MutexLock l(&reload_mu_);
+
+  std::unique_ptr<const InMemoryDB> db;
   {
-    absl::MutexLock l(&reload_mu_);
-    db = std::make_shared<const InMemoryDB>(storage_);
+    const auto previous = snapshot_db();
+    db = std::make_unique<const InMemoryDB>(
+        storage_, options_,
+        options_.incremental_reload ? previous.get() : nullptr);
   }
 
-  absl::WriterMutexLock l(&mutex_);
-  db_ = std::move(db);
+  // Readers move on to the new snapshot immediately, and the old one is
+  // destroyed once the last of its readers is done with it.
+  db_.Update(std::move(db));
+}
+
+// static
+bool ServiceImpl::WriteIndexImage(const aur_storage::Storage* storage,
+                                  const std::string& path, Options options) {
+  const InMemoryDB db(storage, options, nullptr);
+  return db.WriteImage(path);
 }
 
 grpc::Status ServiceImpl::Lookup(const LookupRequest& request,
@@ -148,31 +348,267 @@ grpc::Status ServiceImpl::Lookup(const LookupRequest& request,
 }
 
 // static
-grpc::Status ServiceImpl::SearchByPredicate(
-    const std::shared_ptr<const InMemoryDB>& db,
-    const SearchPredicate& predicate, const SearchRequest& request,
-    SearchResponse* response) {
-  auto inserter = FieldMaskingBackInserter(
-      request.options().package_field_mask(), response->mutable_packages());
+ServiceImpl::SearchPlan ServiceImpl::PlanSearch(
+    const InMemoryDB& db, const std::vector<SearchIndex::Field>& fields,
+    const std::vector<GlobMatcher>& terms, bool conjunctive) {
+  const SearchIndex& index = db.search_index();
+  SearchPlan plan;
 
-  switch (request.search_logic()) {
-    case SearchRequest::SEARCHLOGIC_DISJUNCTIVE:
-      for (const auto& package : db->packages()) {
-        if (absl::c_any_of(request.terms(), [&](const std::string& term) {
-              return predicate(package, term);
-            })) {
-          inserter = &package;
+  // Candidates for a single term are the union of its candidates in each
+  // field.
+  auto term_candidates = [&](const GlobMatcher& term,
+                             std::vector<uint32_t>* out) {
+    for (SearchIndex::Field field : fields) {
+      if (!index.Candidates(field, term.pattern(), out)) {
+        return false;
+      }
+    }
+    return true;
+  };
+
+  if (conjunctive) {
+    // Every match must be a candidate of every term, so the term with the
+    // fewest candidates bounds the search, and is also the one most likely to
+    // reject a package.
+    const size_t num_packages = db.packages().size();
+    std::vector<size_t> estimates(terms.size());
+    for (size_t i = 0; i < terms.size(); ++i) {
+      if (terms[i].MatchesEverything()) {
+        continue;
+      }
+
+      size_t estimate = 0;
+      for (SearchIndex::Field field : fields) {
+        estimate += index.EstimateCandidates(field, terms[i].pattern());
+      }
+      estimates[i] = std::min(estimate, num_packages);
+      plan.term_order.push_back(i);
+    }
+    std::stable_sort(plan.term_order.begin(), plan.term_order.end(),
+                     [&](size_t a, size_t b) {
+                       return estimates[a] < estimates[b];
+                     });
+
+    if (!plan.term_order.empty() &&
+        estimates[plan.term_order[0]] < num_packages) {
+      plan.narrowed =
+          term_candidates(terms[plan.term_order[0]], &plan.candidates);
+    }
+  } else {
+    // A match may come from any term, so every term must be narrowed.
+    plan.narrowed = true;
+    for (const GlobMatcher& term : terms) {
+      if (!term_candidates(term, &plan.candidates)) {
+        plan.narrowed = false;
+        break;
+      }
+    }
+  }
+
+  if (plan.narrowed) {
+    std::sort(plan.candidates.begin(), plan.candidates.end());
+    plan.candidates.erase(
+        std::unique(plan.candidates.begin(), plan.candidates.end()),
+        plan.candidates.end());
+  } else {
+    plan.candidates.clear();
+  }
+  return plan;
+}
+
+void ServiceImpl::SearchByFields(
+    const InMemoryDB& db, const std::vector<SearchIndex::Field>& fields,
+    const SearchRequest& request, bool conjunctive, const PositionOrder& order,
+    size_t limit, std::vector<uint32_t>* positions, size_t* total) const {
+  // Compile each term once, rather than once per package.
+  std::vector<GlobMatcher> terms(request.terms().begin(),
+                                 request.terms().end());
+
+  // A disjunctive search matches all of its terms against each field in a
+  // single pass, rather than once per term.
+  const GlobSet any_term(conjunctive ? std::vector<GlobMatcher>() : terms);
+
+  const SearchPlan plan = PlanSearch(db, fields, terms, conjunctive);
+  const SearchIndex& index = db.search_index();
+
+  // Terms are matched against the snapshot's lowercased copies of the fields,
+  // which are packed contiguously in package order, rather than against the
+  // packages themselves.
+  auto matches_any_field = [&](uint32_t position, const auto& matcher) {
+    return absl::c_any_of(fields, [&](SearchIndex::Field field) {
+      return matcher.MatchesLowercase(index.Value(field, position));
+    });
+  };
+  auto matches = [&](uint32_t position) {
+    if (!conjunctive) {
+      return matches_any_field(position, any_term);
+    }
+
+    return absl::c_all_of(plan.term_order, [&](size_t term) {
+      return matches_any_field(position, terms[term]);
+    });
+  };
+
+  // Candidates are in snapshot order, so results come out in the same order
+  // either way.
+  const size_t num_positions =
+      plan.narrowed ? plan.candidates.size() : db.packages().size();
+  auto position_at = [&](size_t i) {
+    return plan.narrowed ? plan.candidates[i] : static_cast<uint32_t>(i);
+  };
+
+  auto scan = [&](size_t begin, size_t end, TopPositions* top) {
+    for (size_t i = begin; i < end && !top->done(); ++i) {
+      const uint32_t position = position_at(i);
+      if (matches(position)) {
+        top->Offer(position);
+      }
+    }
+  };
+
+  const size_t shard_size = std::max<size_t>(1, options_.search_shard_size);
+  const size_t num_shards = (num_positions + shard_size - 1) / shard_size;
+  TopPositions top(limit, order);
+  if (num_shards <= 1) {
+    scan(0, num_positions, &top);
+  } else {
+    // Each shard covers a contiguous range of positions, so merging the
+    // shards in order preserves snapshot order.
+    std::vector<TopPositions> shard_tops(num_shards, top);
+    search_pool_->ParallelFor(num_shards, [&](size_t shard) {
+      scan(shard * shard_size,
+           std::min(num_positions, (shard + 1) * shard_size),
+           &shard_tops[shard]);
+    });
+
+    for (const auto& shard_top : shard_tops) {
+      top.Merge(shard_top);
+    }
+  }
+
+  *positions = top.Take();
+  *total = top.count();
+}
+
+void ServiceImpl::SearchByWords(const InMemoryDB& db,
+                                const SearchRequest& request, bool conjunctive,
+                                const PositionOrder& order, size_t limit,
+                                std::vector<uint32_t>* positions,
+                                size_t* total) const {
+  std::vector<std::string> words;
+  for (const std::string& term : request.terms()) {
+    TextIndex::Tokenize(term, &words);
+  }
+
+  // Only the most relevant matches are ever considered.
+  const size_t max_results = options_.word_search_limit == 0
+                                 ? SIZE_MAX
+                                 : options_.word_search_limit;
+
+  if (order) {
+    TopPositions top(limit, order);
+    for (const auto& result : db.text_index().Search(
+             words, conjunctive, options_.word_search_limit)) {
+      top.Offer(result.position);
+    }
+
+    *positions = top.Take();
+    *total = top.count();
+    return;
+  }
+
+  // Fetching one more than the limit tells whether there are more.
+  const size_t fetch = limit < max_results ? limit + 1 : max_results;
+  const auto results = db.text_index().Search(
+      words, conjunctive, fetch == SIZE_MAX ? 0 : fetch);
+
+  *total = results.size();
+  positions->clear();
+  for (size_t i = 0; i < results.size() && i < limit; ++i) {
+    positions->push_back(results[i].position);
+  }
+}
+
+// static
+void ServiceImpl::SearchByFuzzyName(const InMemoryDB& db,
+                                    const SearchRequest& request,
+                                    bool conjunctive,
+                                    const PositionOrder& order, size_t limit,
+                                    std::vector<uint32_t>* positions,
+                                    size_t* total) {
+  // The distance of each name from the terms: the closest term for a
+  // disjunctive search, or the sum over every term for a conjunctive one.
+  struct Closeness {
+    uint32_t distance = 0;
+    int terms = 0;
+  };
+
+  absl::flat_hash_map<uint32_t, Closeness> closeness;
+  std::vector<SearchIndex::Similar> matches;
+  for (int i = 0; i < request.terms_size(); ++i) {
+    const std::string& term = request.terms(i);
+    matches.clear();
+    db.search_index().FindSimilar(SearchIndex::Field::kName, term,
+                                  term.size() <= 4 ? 1 : 2, &matches);
+
+    for (const auto& match : matches) {
+      if (conjunctive) {
+        auto iter = closeness.find(match.position);
+        if (iter == closeness.end()) {
+          if (i > 0) {
+            continue;
+          }
+          iter = closeness.emplace(match.position, Closeness()).first;
         }
+        iter->second.distance += match.distance;
+        ++iter->second.terms;
+      } else {
+        auto [iter, inserted] = closeness.try_emplace(
+            match.position, Closeness{match.distance, 1});
+        iter->second.distance =
+            std::min(iter->second.distance, match.distance);
       }
+    }
+  }
+
+  std::vector<std::pair<uint32_t, uint32_t>> results;
+  for (const auto& [position, entry] : closeness) {
+    if (!conjunctive || entry.terms == request.terms_size()) {
+      results.emplace_back(entry.distance, position);
+    }
+  }
+
+  if (order) {
+    TopPositions top(limit, order);
+    for (const auto& [distance, position] : results) {
+      top.Offer(position);
+    }
+
+    *positions = top.Take();
+    *total = top.count();
+    return;
+  }
+
+  // Closest first, and then in storage order.
+  std::sort(results.begin(), results.end());
+  *total = results.size();
+  positions->clear();
+  for (size_t i = 0; i < results.size() && i < limit; ++i) {
+    positions->push_back(results[i].second);
+  }
+}
+
+grpc::Status ServiceImpl::Search(const SearchRequest& request,
+                                 SearchResponse* response) const {
+  const auto db = snapshot_db();
+
+  bool conjunctive;
+  switch (request.search_logic()) {
+    case SearchRequest::SEARCHLOGIC_DISJUNCTIVE:
+      conjunctive = false;
       break;
     case SearchRequest::SEARCHLOGIC_CONJUNCTIVE:
-      for (const auto& package : db->packages()) {
-        if (absl::c_all_of(request.terms(), [&](const std::string& term) {
-              return predicate(package, term);
-            })) {
-          inserter = &package;
-        }
-      }
+      conjunctive = true;
       break;
     default:
       return grpc::Status(grpc::StatusCode::UNIMPLEMENTED,
@@ -181,18 +617,77 @@ grpc::Status ServiceImpl::SearchByPredicate(
                                            request.search_logic())));
   }
 
-  return grpc::Status::OK;
-}
+  PositionOrder order;
+  switch (request.order_by()) {
+    case SearchRequest::ORDERBY_UNKNOWN:
+    case SearchRequest::ORDERBY_RELEVANCE:
+      break;
+    case SearchRequest::ORDERBY_NAME:
+      order = [&index = db->search_index()](uint32_t a, uint32_t b) {
+        const auto name_a = index.Value(SearchIndex::Field::kName, a);
+        const auto name_b = index.Value(SearchIndex::Field::kName, b);
+        return name_a != name_b ? name_a < name_b : a < b;
+      };
+      break;
+    case SearchRequest::ORDERBY_VOTES:
+      order = DescendingOrder(db->packages(), &Package::votes);
+      break;
+    case SearchRequest::ORDERBY_POPULARITY:
+      order = DescendingOrder(db->packages(), &Package::popularity);
+      break;
+    case SearchRequest::ORDERBY_MODIFIED:
+      order = DescendingOrder(db->packages(), &Package::modified);
+      break;
+    default:
+      return grpc::Status(
+          grpc::StatusCode::UNIMPLEMENTED,
+          absl::StrCat("Unimplemented order_by kind ",
+                       SearchRequest::OrderBy_Name(request.order_by())));
+  }
 
-grpc::Status ServiceImpl::Search(const SearchRequest& request,
-                                 SearchResponse* response) const {
-  const auto db = snapshot_db();
+  if (request.page_size() < 0) {
+    return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                        "page_size must not be negative");
+  }
 
+  size_t offset = 0;
+  if (!request.page_token().empty()) {
+    uint64_t generation;
+    if (!DecodePageToken(request, &generation, &offset) ||
+        offset > db->packages().size()) {
+      return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                          "page_token does not belong to this search");
+    }
+    if (generation != db->generation()) {
+      return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION,
+                          "page_token has expired; restart the search");
+    }
+  }
+
+  // Results before the page are selected too, and then skipped.
+  const size_t limit =
+      request.page_size() == 0 ? SIZE_MAX : offset + request.page_size();
+
+  std::vector<uint32_t> positions;
+  size_t total;
   switch (request.search_by()) {
     case SearchRequest::SEARCHBY_NAME_DESC:
-      return SearchByPredicate(db, &SearchOneNameDesc, request, response);
+      SearchByFields(
+          *db, {SearchIndex::Field::kName, SearchIndex::Field::kDescription},
+          request, conjunctive, order, limit, &positions, &total);
+      break;
     case SearchRequest::SEARCHBY_NAME:
-      return SearchByPredicate(db, &SearchOneName, request, response);
+      SearchByFields(*db, {SearchIndex::Field::kName}, request, conjunctive,
+                     order, limit, &positions, &total);
+      break;
+    case SearchRequest::SEARCHBY_WORDS:
+      SearchByWords(*db, request, conjunctive, order, limit, &positions,
+                    &total);
+      break;
+    case SearchRequest::SEARCHBY_NAME_FUZZY:
+      SearchByFuzzyName(*db, request, conjunctive, order, limit, &positions,
+                        &total);
+      break;
     default:
       return grpc::Status(
           grpc::StatusCode::UNIMPLEMENTED,
@@ -200,12 +695,26 @@ grpc::Status ServiceImpl::Search(const SearchRequest& request,
                        SearchRequest::SearchBy_Name(request.search_by())));
   }
 
+  if (positions.size() > offset) {
+    response->mutable_packages()->Reserve(positions.size() - offset);
+    auto inserter = FieldMaskingBackInserter(
+        request.options().package_field_mask(), response->mutable_packages());
+    for (size_t i = offset; i < positions.size(); ++i) {
+      inserter = db->packages()[positions[i]];
+    }
+  }
+
+  if (total > limit) {
+    response->set_next_page_token(
+        EncodePageToken(request, db->generation(), limit));
+  }
+
   return grpc::Status::OK;
 }
 
 // static
 absl::flat_hash_set<const Package*> ServiceImpl::ResolveProviders(
-    const std::shared_ptr<const InMemoryDB>& db, const std::string& depstring) {
+    const InMemoryDB& db, const std::string& depstring) {
   const ParsedDependency dep(depstring);
   auto dep_satisfied_by = [&](const Package* p) { return dep.SatisfiedBy(*p); };
 
@@ -216,8 +725,8 @@ absl::flat_hash_set<const Package*> ServiceImpl::ResolveProviders(
                     dep_satisfied_by);
   };
 
-  resolve_by_idx(db->idx_pkgname());
-  resolve_by_idx(db->idx_provides());
+  resolve_by_idx(db.idx_pkgname());
+  resolve_by_idx(db.idx_provides());
 
   return providers;
 }
@@ -232,7 +741,7 @@ grpc::Status ServiceImpl::Resolve(const ResolveRequest& request,
     auto resolved = response->add_resolved_packages();
     resolved->set_depstring(depstring);
 
-    const auto providers = ResolveProviders(db, depstring);
+    const auto providers = ResolveProviders(*db, depstring);
     resolved->mutable_providers()->Reserve(providers.size());
 
     absl::c_copy(providers, FieldMaskingBackInserter(
@@ -243,75 +752,286 @@ grpc::Status ServiceImpl::Resolve(const ResolveRequest& request,
   return grpc::Status::OK;
 }
 
-const std::shared_ptr<const ServiceImpl::InMemoryDB> ServiceImpl::snapshot_db()
+RcuPointer<ServiceImpl::InMemoryDB>::ReadLock ServiceImpl::snapshot_db()
     const {
-  absl::ReaderMutexLock l(&mutex_);
-  return db_;
+  return db_.Read();
 }
 
-void ServiceImpl::InMemoryDB::LoadPackages(
-    const aur_storage::Storage* storage) {
+// static
+const ServiceImpl::InMemoryDB::IndexDefinition
+    ServiceImpl::InMemoryDB::kIndexDefinitions[] = {
+        // Indexes with a perfect hash are the slowest to build, and are
+        // listed first so that BuildIndexes() starts on them before the
+        // other package indexes.
+        //
+        // Lookup and Resolve go through these two on every request.
+        {"pkgname", &InMemoryDB::idx_pkgname_,
+         &ScalarFieldIndex<&Package::name, true>},
+        {"pkgbase", &InMemoryDB::idx_pkgbase_,
+         &ScalarFieldIndex<&Package::pkgbase, true>},
+        {"maintainers", &InMemoryDB::idx_maintainers_,
+         &RepeatedFieldIndex<&Package::maintainers, true>},
+        {"groups", &InMemoryDB::idx_groups_,
+         &RepeatedFieldIndex<&Package::groups>},
+        {"keywords", &InMemoryDB::idx_keywords_,
+         &RepeatedFieldIndex<&Package::keywords>},
+        {"provides", &InMemoryDB::idx_provides_,
+         &DepstringFieldIndex<&Package::provides>},
+        {"depends", &InMemoryDB::idx_depends_,
+         &DepstringFieldIndex<&Package::depends>},
+        {"optdepends", &InMemoryDB::idx_optdepends_,
+         &DepstringFieldIndex<&Package::optdepends>},
+        {"makedepends", &InMemoryDB::idx_makedepends_,
+         &DepstringFieldIndex<&Package::makedepends>},
+        {"checkdepends", &InMemoryDB::idx_checkdepends_,
+         &DepstringFieldIndex<&Package::checkdepends>},
+};
+
+ServiceImpl::InMemoryDB::InMemoryDB(const aur_storage::Storage* storage,
+                                    const Options& options,
+                                    const InMemoryDB* previous)
+    : generation_(NextGeneration()) {
+  if (previous != nullptr && !previous->Shareable()) {
+    previous = nullptr;
+  }
+
+  std::vector<const Package*> removed, added;
+  const bool loaded_all =
+      LoadPackages(storage, options.load_threads, previous, &removed, &added);
+
+  // Prebuilt indexes refer to packages by their position in the storage, so
+  // they're only usable if nothing was skipped.
+  if (loaded_all && LoadPrebuiltIndexes(storage)) {
+    BuildIndexes(options.load_threads, /*package_indexes=*/false);
+    return;
+  }
+
+  // Patching costs roughly as much per package as indexing from scratch, so
+  // only patch when the delta is small relative to the snapshot.
+  if (previous != nullptr && !previous->prebuilt_indexes_ &&
+      removed.size() + added.size() <= packages_->size() / 4) {
+    PatchIndexes(*previous, removed, added);
+    BuildIndexes(options.load_threads, /*package_indexes=*/false);
+  } else {
+    BuildIndexes(options.load_threads, /*package_indexes=*/true);
+  }
+}
+
+// static
+google::protobuf::ArenaOptions ServiceImpl::InMemoryDB::ArenaOptions() {
+  // The default arena blocks top out at 8KiB, which would still leave us with
+  // tens of thousands of allocations for a full AUR snapshot.
+  google::protobuf::ArenaOptions options;
+  options.start_block_size = 64 << 10;
+  options.max_block_size = 4 << 20;
+  return options;
+}
+
+bool ServiceImpl::InMemoryDB::Shareable() const {
+  // Every incremental reload adds an arena and strands the packages it
+  // replaces in an older one. Force a full reload once either gets out of
+  // hand.
+  constexpr size_t kMaxArenas = 16;
+
+  return !entries_.empty() && arenas_.size() < kMaxArenas &&
+         retired_packages_ <= packages_->size() / 4;
+}
+
+bool ServiceImpl::InMemoryDB::LoadPackages(
+    const aur_storage::Storage* storage, int num_threads,
+    const InMemoryDB* previous, std::vector<const Package*>* removed,
+    std::vector<const Package*>* added) {
   const absl::Time start = absl::Now();
 
   const std::vector<std::string> names = storage->List();
-  packages_.reserve(names.size());
-  for (const auto& name : names) {
-    std::string s;
-    Package p;
-    if (!storage->Get(name, &s) || !p.ParseFromString(s)) {
+  auto arena = std::make_shared<google::protobuf::Arena>(ArenaOptions());
+
+  // Each worker fills in its own slots, and the results are merged in the
+  // order given by the storage. Allocation from the arena is thread-safe. The
+  // fingerprint is taken before reading so that a concurrent write is always
+  // caught by the next reload. Packages are read in batches so that storage
+  // can overlap the reads within a batch.
+  constexpr size_t kBatchSize = 256;
+  const size_t num_batches = (names.size() + kBatchSize - 1) / kBatchSize;
+
+  std::vector<const Package*> packages(names.size());
+  std::vector<uint64_t> fingerprints(names.size());
+  std::vector<char> fingerprinted(names.size());
+  std::vector<char> loaded(names.size());
+  std::vector<char> reused(names.size());
+  aur_util::ParallelFor(num_batches, num_threads, [&](size_t batch) {
+    const size_t begin = batch * kBatchSize;
+    const size_t end = std::min(begin + kBatchSize, names.size());
+
+    std::vector<size_t> unread;
+    std::vector<std::string> keys;
+    std::vector<Package*> unread_packages;
+    for (size_t i = begin; i < end; ++i) {
+      fingerprinted[i] = storage->Fingerprint(names[i], &fingerprints[i]);
+      if (fingerprinted[i] && previous != nullptr) {
+        auto iter = previous->entries_.find(names[i]);
+        if (iter != previous->entries_.end() &&
+            iter->second.fingerprint == fingerprints[i]) {
+          packages[i] = iter->second.package;
+          loaded[i] = reused[i] = true;
+          continue;
+        }
+      }
+
+      auto* package =
+          google::protobuf::Arena::CreateMessage<Package>(arena.get());
+      packages[i] = package;
+      unread.push_back(i);
+      keys.push_back(names[i]);
+      unread_packages.push_back(package);
+    }
+
+    const auto read = ReadPackages(storage, keys, unread_packages);
+    for (size_t j = 0; j < unread.size(); ++j) {
+      loaded[unread[j]] = read[j];
+    }
+  });
+
+  const bool all_fingerprinted =
+      absl::c_all_of(fingerprinted, [](char c) { return c; });
+
+  absl::flat_hash_set<const Package*> reused_packages;
+  std::vector<const Package*> snapshot_packages;
+  snapshot_packages.reserve(names.size());
+  for (size_t i = 0; i < names.size(); ++i) {
+    if (!loaded[i]) {
       // Unlikely
-      std::cerr << "error: failed to load package: " << name << '\n';
+      std::cerr << "error: failed to load package: " << names[i] << '\n';
       continue;
     }
 
-    packages_.push_back(std::move(p));
+    snapshot_packages.push_back(packages[i]);
+    if (all_fingerprinted) {
+      entries_.emplace(names[i], Entry{fingerprints[i], packages[i]});
+    }
+
+    if (reused[i]) {
+      reused_packages.insert(packages[i]);
+    } else {
+      added->push_back(packages[i]);
+    }
+  }
+
+  packages_ = std::make_shared<const std::vector<const Package*>>(
+      std::move(snapshot_packages));
+
+  arenas_.push_back(std::move(arena));
+  if (!reused_packages.empty()) {
+    for (const Package* package : *previous->packages_) {
+      if (!reused_packages.contains(package)) {
+        removed->push_back(package);
+      }
+    }
+
+    arenas_.insert(arenas_.end(), previous->arenas_.begin(),
+                   previous->arenas_.end());
+    retired_packages_ = previous->retired_packages_ + removed->size();
   }
 
   const absl::Duration load_time = absl::Now() - start;
   std::cout << "caching complete in " << absl::FormatDuration(load_time) << ". "
-            << packages_.size() << " packages loaded.\n";
+            << packages_->size() << " packages loaded";
+  if (!reused_packages.empty()) {
+    std::cout << " (" << reused_packages.size() << " reused, " << added->size()
+              << " added or changed, " << removed->size()
+              << " removed or changed)";
+  }
+  std::cout << ".\n";
+
+  return packages_->size() == names.size();
+}
+
+bool ServiceImpl::InMemoryDB::LoadPrebuiltIndexes(
+    const aur_storage::Storage* storage) {
+  const absl::Time start = absl::Now();
+
+  for (const auto& [name, index, create] : kIndexDefinitions) {
+    std::string_view image;
+    std::shared_ptr<const void> pin;
+    if (!storage->GetSection(absl::StrCat("index/", name), &image, &pin)) {
+      return false;
+    }
+
+    if (!PackageIndex::FromImage(name, image, std::move(pin), packages_,
+                                 &(this->*index))) {
+      std::cerr << "error: ignoring malformed prebuilt index: " << name
+                << '\n';
+      return false;
+    }
+  }
+
+  prebuilt_indexes_ = true;
+
+  const absl::Duration load_time = absl::Now() - start;
+  std::cout << "prebuilt indexes loaded in " << absl::FormatDuration(load_time)
+            << ".\n";
+  return true;
 }
 
-void ServiceImpl::InMemoryDB::BuildIndexes() {
+bool ServiceImpl::InMemoryDB::WriteImage(const std::string& path) const {
+  aur_storage::PackedStorageBuilder builder;
+  for (const Package* package : *packages_) {
+    builder.Add(package->name(), package->SerializeAsString());
+  }
+
+  for (const auto& [name, index, create] : kIndexDefinitions) {
+    std::string image;
+    if (!(this->*index).ToImage(packages_, &image)) {
+      return false;
+    }
+
+    builder.AddSection(absl::StrCat("index/", name), std::move(image));
+  }
+
+  return builder.Write(path);
+}
+
+void ServiceImpl::InMemoryDB::BuildIndexes(int num_threads,
+                                           bool package_indexes) {
   const absl::Time start = absl::Now();
 
-  idx_pkgname_ = PackageIndex::Create(
-      packages_, "pkgname",
-      PackageIndex::ScalarFieldIndexingAdapter(&Package::name));
-  idx_pkgbase_ = PackageIndex::Create(
-      packages_, "pkgbase",
-      PackageIndex::ScalarFieldIndexingAdapter(&Package::pkgbase));
-  idx_maintainers_ = PackageIndex::Create(
-      packages_, "maintainers",
-      PackageIndex::RepeatedFieldIndexingAdapter(&Package::maintainers, true));
-  idx_provides_ = PackageIndex::Create(
-      packages_, "provides",
-      PackageIndex::DepstringFieldIndexingAdapter(&Package::provides));
-  idx_groups_ = PackageIndex::Create(
-      packages_, "groups",
-      PackageIndex::RepeatedFieldIndexingAdapter(&Package::groups));
-  idx_keywords_ = PackageIndex::Create(
-      packages_, "keywords",
-      PackageIndex::RepeatedFieldIndexingAdapter(&Package::keywords));
-  idx_provides_ = PackageIndex::Create(
-      packages_, "provides",
-      PackageIndex::DepstringFieldIndexingAdapter(&Package::provides));
-  idx_depends_ = PackageIndex::Create(
-      packages_, "depends",
-      PackageIndex::DepstringFieldIndexingAdapter(&Package::depends));
-  idx_optdepends_ = PackageIndex::Create(
-      packages_, "optdepends",
-      PackageIndex::DepstringFieldIndexingAdapter(&Package::optdepends));
-  idx_makedepends_ = PackageIndex::Create(
-      packages_, "makedepends",
-      PackageIndex::DepstringFieldIndexingAdapter(&Package::makedepends));
-  idx_checkdepends_ = PackageIndex::Create(
-      packages_, "checkdepends",
-      PackageIndex::DepstringFieldIndexingAdapter(&Package::checkdepends));
+  // Indexes are independent of one another, so build them all at once. Each
+  // invocation writes only to its own index. The search and text indexes are
+  // the largest, so they go first.
+  const size_t num_indexes =
+      2 + (package_indexes ? std::size(kIndexDefinitions) : 0);
+  aur_util::ParallelFor(num_indexes, num_threads, [&](size_t i) {
+    if (i == 0) {
+      search_index_ = SearchIndex::Build(*packages_);
+      return;
+    }
+    if (i == 1) {
+      text_index_ = TextIndex::Build(*packages_);
+      return;
+    }
+
+    const auto& definition = kIndexDefinitions[i - 2];
+    this->*definition.index = definition.create(packages_, definition.name);
+  });
 
   const absl::Duration load_time = absl::Now() - start;
   std::cout << "index building complete in " << absl::FormatDuration(load_time)
             << ".\n";
 }
 
+void ServiceImpl::InMemoryDB::PatchIndexes(
+    const InMemoryDB& previous, const std::vector<const Package*>& removed,
+    const std::vector<const Package*>& added) {
+  const absl::Time start = absl::Now();
+
+  for (const auto& definition : kIndexDefinitions) {
+    this->*definition.index =
+        (previous.*definition.index).Patch(removed, added, packages_);
+  }
+
+  const absl::Duration load_time = absl::Now() - start;
+  std::cout << "index patching complete in " << absl::FormatDuration(load_time)
+            << ".\n";
+}
+
 }  // namespace aur_internal
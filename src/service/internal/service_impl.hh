@@ -1,14 +1,22 @@
 #pragma once
 
+#include <cstdint>
+#include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 
-#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
-#include "absl/synchronization/mutex.h"
 #include "aur_internal.pb.h"
+#include "google/protobuf/arena.h"
 #include "grpcpp/grpcpp.h"
+#include "service/internal/glob.hh"
 #include "service/internal/package_index.hh"
+#include "service/internal/rcu.hh"
+#include "service/internal/search_index.hh"
+#include "service/internal/text_index.hh"
+#include "service/internal/thread_pool.hh"
 #include "storage/storage.hh"
 
 namespace aur_internal {
@@ -19,7 +27,35 @@ namespace aur_internal {
 // be reloaded during runtime without interruptions to serving.
 class ServiceImpl final {
  public:
+  struct Options {
+    // Number of threads used to read and parse packages from storage, and to
+    // build indexes. A non-positive value selects the number of available
+    // CPUs.
+    int load_threads = 0;
+
+    // When the storage supports fingerprints, reuse packages which haven't
+    // changed since the previous snapshot and patch the indexes with only the
+    // changed packages.
+    bool incremental_reload = true;
+
+    // Number of threads shared by all Search requests for scanning packages
+    // in parallel, on top of the thread handling each request. Keeping this
+    // below the number of CPUs leaves room for other requests while a broad
+    // search is running. A non-positive value selects half of the available
+    // CPUs.
+    int search_threads = 0;
+
+    // Number of packages scanned by each task of a parallel search. Scans of
+    // no more packages than this run entirely on the handling thread.
+    size_t search_shard_size = 8192;
+
+    // Maximum number of packages returned by a SEARCHBY_WORDS search. Only
+    // the most relevant packages are kept.
+    size_t word_search_limit = 250;
+  };
+
   explicit ServiceImpl(const aur_storage::Storage* storage);
+  ServiceImpl(const aur_storage::Storage* storage, Options options);
 
   ServiceImpl(ServiceImpl&&) = delete;
   ServiceImpl& operator=(ServiceImpl&&) = delete;
@@ -36,24 +72,44 @@ class ServiceImpl final {
 
   void Reload();
 
+  // Loads a snapshot of |storage| and writes it to |path| as a packed
+  // database with prebuilt package indexes, which a later ServiceImpl can
+  // serve without building those indexes of its own. The search and text
+  // indexes aren't part of the image, and are still built on every load.
+  static bool WriteIndexImage(const aur_storage::Storage* storage,
+                              const std::string& path, Options options);
+
  private:
   // InMemoryDB is an indexed, in-memory storage version of a backing store. It
   // is immutable after construction and changes to the underlying storage will
-  // not be reflected.
+  // not be reflected. All packages are allocated from arenas, so that
+  // destroying a snapshot releases a handful of large blocks rather than every
+  // individual string and repeated field.
   class InMemoryDB final {
    public:
-    explicit InMemoryDB(const aur_storage::Storage* storage) {
-      LoadPackages(storage);
-      BuildIndexes();
-    }
+    // Loads a snapshot of |storage|. If |previous| is given, packages which
+    // are unchanged since it was loaded are shared with it rather than parsed
+    // again, and its package indexes are patched rather than rebuilt. Package
+    // indexes are taken from the storage instead if it carries prebuilt ones.
+    //
+    // The search and text indexes are always built from scratch, which costs
+    // a pass over every package on every load. Both refer to packages by
+    // position, which shifts with every package added or removed, and text
+    // scores depend on statistics over the whole snapshot, so neither can be
+    // patched or served out of an image.
+    InMemoryDB(const aur_storage::Storage* storage, const Options& options,
+               const InMemoryDB* previous);
 
-    InMemoryDB(InMemoryDB&&) = default;
-    InMemoryDB& operator=(InMemoryDB&&) = default;
+    InMemoryDB(InMemoryDB&&) = delete;
+    InMemoryDB& operator=(InMemoryDB&&) = delete;
 
     InMemoryDB(const InMemoryDB&) = delete;
     InMemoryDB& operator=(const InMemoryDB&) = delete;
 
-    const std::vector<Package>& packages() const { return packages_; }
+    // Identifies this snapshot among all those loaded by the process.
+    uint64_t generation() const { return generation_; }
+
+    const std::vector<const Package*>& packages() const { return *packages_; }
     const PackageIndex& idx_pkgname() const { return idx_pkgname_; }
     const PackageIndex& idx_pkgbase() const { return idx_pkgbase_; }
     const PackageIndex& idx_maintainers() const { return idx_maintainers_; }
@@ -64,12 +120,76 @@ class ServiceImpl final {
     const PackageIndex& idx_optdepends() const { return idx_optdepends_; }
     const PackageIndex& idx_makedepends() const { return idx_makedepends_; }
     const PackageIndex& idx_checkdepends() const { return idx_checkdepends_; }
+    const SearchIndex& search_index() const { return search_index_; }
+    const TextIndex& text_index() const { return text_index_; }
+
+    // Writes the packages and indexes of this snapshot to |path|, in the
+    // format read by LoadPrebuiltIndexes().
+    bool WriteImage(const std::string& path) const;
 
    private:
-    void LoadPackages(const aur_storage::Storage* storage);
-    void BuildIndexes();
+    struct Entry {
+      uint64_t fingerprint;
+      const Package* package;
+    };
+
+    // Describes one of the indexes of a snapshot. Every index is defined
+    // exactly once, in kIndexDefinitions, and building, patching, loading and
+    // writing indexes all work from that table.
+    struct IndexDefinition {
+      const char* name;
+      PackageIndex InMemoryDB::*index;
+      PackageIndex (*create)(
+          std::shared_ptr<const std::vector<const Package*>> packages,
+          const std::string& name);
+    };
+
+    static const IndexDefinition kIndexDefinitions[];
+
+    static google::protobuf::ArenaOptions ArenaOptions();
+
+    // Returns true if this snapshot can share packages with a successor
+    // without holding on to too much garbage.
+    bool Shareable() const;
+
+    // Loads all packages from |storage|, reusing those from |previous| when
+    // possible. The packages which differ from |previous| are returned via
+    // |removed| and |added|. Returns true if every package was loaded.
+    bool LoadPackages(const aur_storage::Storage* storage, int num_threads,
+                      const InMemoryDB* previous,
+                      std::vector<const Package*>* removed,
+                      std::vector<const Package*>* added);
+    // Builds the search and text indexes, along with the package indexes if
+    // |package_indexes| is set.
+    void BuildIndexes(int num_threads, bool package_indexes);
+    bool LoadPrebuiltIndexes(const aur_storage::Storage* storage);
+    void PatchIndexes(const InMemoryDB& previous,
+                      const std::vector<const Package*>& removed,
+                      const std::vector<const Package*>& added);
 
-    std::vector<Package> packages_;
+    // Arenas owning the packages in this snapshot. Arenas are shared with
+    // earlier snapshots when packages are reused, and so they must outlive
+    // everything that points into them. They're declared first for that
+    // reason.
+    std::vector<std::shared_ptr<google::protobuf::Arena>> arenas_;
+
+    uint64_t generation_;
+
+    // The packages of this snapshot, in storage order. Indexes refer to
+    // packages by their position here, and all of them share this table.
+    std::shared_ptr<const std::vector<const Package*>> packages_;
+
+    // Fingerprint and package for each storage key, used to detect changes on
+    // the next reload. Empty if the storage doesn't support fingerprints.
+    absl::flat_hash_map<std::string, Entry> entries_;
+
+    // Number of packages held alive by arenas_ that are no longer a part of
+    // this snapshot.
+    size_t retired_packages_ = 0;
+
+    // True if the indexes are served out of images provided by the storage.
+    // Such indexes can't be patched.
+    bool prebuilt_indexes_ = false;
 
     PackageIndex idx_pkgname_;
     PackageIndex idx_pkgbase_;
@@ -81,25 +201,71 @@ class ServiceImpl final {
     PackageIndex idx_optdepends_;
     PackageIndex idx_makedepends_;
     PackageIndex idx_checkdepends_;
+
+    SearchIndex search_index_;
+    TextIndex text_index_;
   };
 
-  const std::shared_ptr<const InMemoryDB> snapshot_db() const;
+  // Pins the current snapshot for as long as the returned lock is held.
+  RcuPointer<InMemoryDB>::ReadLock snapshot_db() const;
+
+  // Orders package positions for search results. Empty for the default
+  // order.
+  using PositionOrder = std::function<bool(uint32_t, uint32_t)>;
 
-  using SearchPredicate =
-      std::function<bool(const Package&, const std::string&)>;
-  static grpc::Status SearchByPredicate(
-      const std::shared_ptr<const InMemoryDB>& db,
-      const SearchPredicate& predicate, const SearchRequest& request,
-      SearchResponse* response);
+  // Searches produce the positions of the first |limit| matching packages
+  // under |order|, and the total number of matches. The total is only exact
+  // up to |limit| + 1. SearchByFields() matches a term if it matches any of
+  // the given |fields| of a package.
+  void SearchByFields(const InMemoryDB& db,
+                      const std::vector<SearchIndex::Field>& fields,
+                      const SearchRequest& request, bool conjunctive,
+                      const PositionOrder& order, size_t limit,
+                      std::vector<uint32_t>* positions, size_t* total) const;
+
+  void SearchByWords(const InMemoryDB& db, const SearchRequest& request,
+                     bool conjunctive, const PositionOrder& order,
+                     size_t limit, std::vector<uint32_t>* positions,
+                     size_t* total) const;
+
+  static void SearchByFuzzyName(const InMemoryDB& db,
+                                const SearchRequest& request,
+                                bool conjunctive, const PositionOrder& order,
+                                size_t limit, std::vector<uint32_t>* positions,
+                                size_t* total);
+
+  // How to evaluate the terms of a search.
+  struct SearchPlan {
+    // Indexes of the terms that a conjunctive search must check, in the order
+    // to check them. Empty for a disjunctive search.
+    std::vector<size_t> term_order;
+
+    // Whether only |candidates|, in ascending order, need to be considered,
+    // rather than every package.
+    bool narrowed = false;
+    std::vector<uint32_t> candidates;
+  };
+
+  // Plans a search for |terms| in any of |fields|. A conjunctive search skips
+  // terms that match everything and checks the rest most selective first, as
+  // estimated by the search index, so that most packages are rejected by the
+  // first term checked. Only the most selective term's candidates are
+  // collected. A disjunctive search is narrowed to the union of every term's
+  // candidates.
+  static SearchPlan PlanSearch(const InMemoryDB& db,
+                               const std::vector<SearchIndex::Field>& fields,
+                               const std::vector<GlobMatcher>& terms,
+                               bool conjunctive);
 
   static absl::flat_hash_set<const Package*> ResolveProviders(
-      const std::shared_ptr<const InMemoryDB>& db,
-      const std::string& depstring);
+      const InMemoryDB& db, const std::string& depstring);
 
   const aur_storage::Storage* storage_;
+  const Options options_;
+
+  std::unique_ptr<ThreadPool> search_pool_;
 
-  mutable absl::Mutex mutex_;
-  std::shared_ptr<const InMemoryDB> db_ ABSL_GUARDED_BY(mutex_);
+  RcuPointer<InMemoryDB> db_;
 };
 
 }  // namespace aur_internal
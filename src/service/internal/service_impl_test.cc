@@ -2,12 +2,15 @@
 
 #include <filesystem>
 
+#include "absl/strings/numbers.h"
 #include "aur_internal.pb.h"
 #include "gmock/gmock.h"
 #include "google/protobuf/util/field_mask_util.h"
 #include "gtest/gtest.h"
 #include "storage/file_io.hh"
 #include "storage/filesystem_storage.hh"
+#include "storage/packed_storage.hh"
+#include "testing/temporary_directory.hh"
 
 namespace fs = std::filesystem;
 
@@ -20,7 +23,12 @@ using aur_internal::SearchRequest;
 using aur_internal::SearchResponse;
 using aur_internal::ServiceImpl;
 using aur_storage::FilesystemStorage;
+using aur_storage::PackedStorage;
+using aur_storage::PackedStorageBuilder;
+using aur_testing::TemporaryDirectory;
 using testing::AllOf;
+using testing::ElementsAre;
+using testing::IsEmpty;
 using testing::Property;
 using testing::UnorderedElementsAre;
 using testing::UnorderedElementsAreArray;
@@ -57,47 +65,30 @@ void FillFieldMask(aur_internal::RequestOptions* options,
   }
 }
 
-class TemporaryDirectory {
- public:
-  TemporaryDirectory() {
-    Create(testing::UnitTest::GetInstance()->current_test_info()->name());
-  }
-  ~TemporaryDirectory() { std::filesystem::remove_all(tempdir_); }
-
-  const fs::path& dirpath() const { return tempdir_; }
-
- private:
-  void Create(std::string_view designator) {
-    const char* tmpdir = getenv("TMPDIR");
-    if (tmpdir == nullptr) {
-      tmpdir = "/tmp";
-    }
-
-    std::string tmpdir_template =
-        absl::StrCat(tmpdir, "/", designator, ".XXXXXX");
-
-    tempdir_ = mkdtemp(tmpdir_template.data());
-  }
-
-  std::filesystem::path tempdir_;
-};
-
 class ServiceImplTest : public testing::Test {
  protected:
   std::unique_ptr<ServiceImpl> BuildService(
-      const std::vector<Package>& packages) {
+      const std::vector<Package>& packages,
+      ServiceImpl::Options options = ServiceImpl::Options()) {
     for (const auto& p : packages) {
       AddPackage(p);
     }
 
-    return std::make_unique<ServiceImpl>(&storage_);
+    return std::make_unique<ServiceImpl>(&storage_, std::move(options));
   }
 
- private:
+  const FilesystemStorage& storage() const { return storage_; }
+
   void AddPackage(const Package& p) {
     aur_storage::SetBinaryProto(tempdir_.dirpath() / p.name(), p);
   }
 
+  void RemovePackage(const std::string& name) {
+    fs::remove(tempdir_.dirpath() / name);
+  }
+
+ private:
+
   TemporaryDirectory tempdir_;
   FilesystemStorage storage_{tempdir_.dirpath()};
 };
@@ -808,6 +799,254 @@ TEST_F(ServiceImplTest, SearchByNameDescConjunctive) {
               UnorderedElementsAre(Property(&Package::name, "pkgfile-git")));
 }
 
+TEST_F(ServiceImplTest, SearchConjunctiveBroadTermsFirst) {
+  std::vector<Package> packages;
+  for (const char* name : {"expac-git", "auracle-git", "pacman-git",
+                           "pacman-contrib", "pkgfile"}) {
+    auto& p = packages.emplace_back();
+    p.set_name(name);
+    p.set_pkgbase(name);
+    p.set_pkgver("1");
+  }
+  auto service = BuildService(packages);
+
+  auto search = [&](const std::vector<std::string>& terms) {
+    SearchRequest request;
+    SearchResponse response;
+
+    request.set_search_by(SearchRequest::SEARCHBY_NAME);
+    request.set_search_logic(SearchRequest::SEARCHLOGIC_CONJUNCTIVE);
+    for (const auto& term : terms) {
+      request.add_terms(term);
+    }
+    FillFieldMask(request.mutable_options(), {"name"});
+
+    auto status = service->Search(request, &response);
+    EXPECT_TRUE(status.ok()) << status.error_message();
+
+    std::vector<std::string> names;
+    for (const auto& p : response.packages()) {
+      names.push_back(p.name());
+    }
+    return names;
+  };
+
+  // Terms are checked most selective first, which mustn't change results.
+  EXPECT_THAT(search({"*", "*a*", "*-git", "pac*"}),
+              ElementsAre("pacman-git"));
+  EXPECT_THAT(search({"*a*", "*c*"}),
+              UnorderedElementsAre("expac-git", "auracle-git", "pacman-git",
+                                   "pacman-contrib"));
+  EXPECT_THAT(search({"*", "**"}),
+              UnorderedElementsAre("expac-git", "auracle-git", "pacman-git",
+                                   "pacman-contrib", "pkgfile"));
+  EXPECT_THAT(search({"*a*", "*xyz*"}), IsEmpty());
+}
+
+TEST_F(ServiceImplTest, SearchMixesAnchoredAndUnanchoredTerms) {
+  std::vector<Package> packages;
+  for (const char* name : {"expac-git", "auracle-git", "pacman-git",
+                           "pacman-extraponies-git", "pacman-contrib"}) {
+    auto& p = packages.emplace_back();
+    p.set_name(name);
+    p.set_pkgbase(name);
+    p.set_pkgver("1");
+  }
+  auto service = BuildService(packages);
+
+  {
+    SearchRequest request;
+    SearchResponse response;
+
+    request.set_search_by(SearchRequest::SEARCHBY_NAME);
+    request.set_search_logic(SearchRequest::SEARCHLOGIC_CONJUNCTIVE);
+    request.add_terms("PACMAN*");
+    request.add_terms("*-git");
+    FillFieldMask(request.mutable_options(), {"name"});
+
+    auto status = service->Search(request, &response);
+    ASSERT_TRUE(status.ok()) << status.error_message();
+
+    EXPECT_THAT(response.packages(),
+                UnorderedElementsAre(
+                    Property(&Package::name, "pacman-git"),
+                    Property(&Package::name, "pacman-extraponies-git")));
+  }
+
+  {
+    SearchRequest request;
+    SearchResponse response;
+
+    request.set_search_by(SearchRequest::SEARCHBY_NAME);
+    request.set_search_logic(SearchRequest::SEARCHLOGIC_DISJUNCTIVE);
+    request.add_terms("exp*");
+    request.add_terms("*contrib");
+    FillFieldMask(request.mutable_options(), {"name"});
+
+    auto status = service->Search(request, &response);
+    ASSERT_TRUE(status.ok()) << status.error_message();
+
+    EXPECT_THAT(
+        response.packages(),
+        UnorderedElementsAre(Property(&Package::name, "expac-git"),
+                             Property(&Package::name, "pacman-contrib")));
+  }
+}
+
+TEST_F(ServiceImplTest, SearchByWords) {
+  std::vector<Package> packages;
+  {
+    auto& p = packages.emplace_back();
+    p.set_name("expac-git");
+    p.set_description("pacman database extraction utility");
+    p.set_votes(20);
+  }
+  {
+    auto& p = packages.emplace_back();
+    p.set_name("auracle-git");
+    p.set_description("A flexible client for the AUR");
+    p.add_keywords("pacman");
+  }
+  {
+    auto& p = packages.emplace_back();
+    p.set_name("pacman-git");
+    p.set_description("A library-based package manager");
+  }
+  auto service = BuildService(packages);
+
+  {
+    SearchRequest request;
+    SearchResponse response;
+
+    request.set_search_by(SearchRequest::SEARCHBY_WORDS);
+    request.set_search_logic(SearchRequest::SEARCHLOGIC_DISJUNCTIVE);
+    request.add_terms("PACMAN");
+    FillFieldMask(request.mutable_options(), {"name"});
+
+    auto status = service->Search(request, &response);
+    ASSERT_TRUE(status.ok()) << status.error_message();
+
+    // Most relevant first: a name, then a keyword, then a description.
+    EXPECT_THAT(response.packages(),
+                ElementsAre(Property(&Package::name, "pacman-git"),
+                            Property(&Package::name, "auracle-git"),
+                            Property(&Package::name, "expac-git")));
+  }
+
+  {
+    SearchRequest request;
+    SearchResponse response;
+
+    request.set_search_by(SearchRequest::SEARCHBY_WORDS);
+    request.set_search_logic(SearchRequest::SEARCHLOGIC_CONJUNCTIVE);
+    request.add_terms("pacman git");
+    request.add_terms("*database*");
+    FillFieldMask(request.mutable_options(), {"name"});
+
+    auto status = service->Search(request, &response);
+    ASSERT_TRUE(status.ok()) << status.error_message();
+
+    EXPECT_THAT(response.packages(),
+                ElementsAre(Property(&Package::name, "expac-git")));
+  }
+
+  {
+    SearchRequest request;
+    SearchResponse response;
+
+    request.set_search_by(SearchRequest::SEARCHBY_WORDS);
+    request.set_search_logic(SearchRequest::SEARCHLOGIC_DISJUNCTIVE);
+    request.set_page_size(2);
+    request.add_terms("pacman");
+    FillFieldMask(request.mutable_options(), {"name"});
+
+    auto status = service->Search(request, &response);
+    ASSERT_TRUE(status.ok()) << status.error_message();
+
+    EXPECT_THAT(response.packages(),
+                ElementsAre(Property(&Package::name, "pacman-git"),
+                            Property(&Package::name, "auracle-git")));
+    ASSERT_FALSE(response.next_page_token().empty());
+
+    request.set_page_token(response.next_page_token());
+    response.Clear();
+    status = service->Search(request, &response);
+    ASSERT_TRUE(status.ok()) << status.error_message();
+
+    EXPECT_THAT(response.packages(),
+                ElementsAre(Property(&Package::name, "expac-git")));
+    EXPECT_TRUE(response.next_page_token().empty());
+  }
+}
+
+TEST_F(ServiceImplTest, SearchByNameFuzzy) {
+  std::vector<Package> packages;
+  for (const char* name : {"pacman-git", "pacman", "packman", "auracle-git",
+                           "pkgfile", "pacaur"}) {
+    auto& p = packages.emplace_back();
+    p.set_name(name);
+    p.set_pkgbase(name);
+    p.set_pkgver("1");
+  }
+  auto service = BuildService(packages);
+
+  {
+    SearchRequest request;
+    SearchResponse response;
+
+    request.set_search_by(SearchRequest::SEARCHBY_NAME_FUZZY);
+    request.set_search_logic(SearchRequest::SEARCHLOGIC_DISJUNCTIVE);
+    request.add_terms("Pacmna");
+    FillFieldMask(request.mutable_options(), {"name"});
+
+    auto status = service->Search(request, &response);
+    ASSERT_TRUE(status.ok()) << status.error_message();
+
+    // A transposition is two edits, which is as many as a term this long
+    // allows.
+    EXPECT_THAT(response.packages(),
+                ElementsAre(Property(&Package::name, "pacman")));
+  }
+
+  {
+    SearchRequest request;
+    SearchResponse response;
+
+    request.set_search_by(SearchRequest::SEARCHBY_NAME_FUZZY);
+    request.set_search_logic(SearchRequest::SEARCHLOGIC_DISJUNCTIVE);
+    request.add_terms("auracle-gti");
+    request.add_terms("pacma");
+    FillFieldMask(request.mutable_options(), {"name"});
+
+    auto status = service->Search(request, &response);
+    ASSERT_TRUE(status.ok()) << status.error_message();
+
+    // Closest first.
+    EXPECT_THAT(response.packages(),
+                ElementsAre(Property(&Package::name, "pacman"),
+                            Property(&Package::name, "auracle-git"),
+                            Property(&Package::name, "packman")));
+  }
+
+  {
+    SearchRequest request;
+    SearchResponse response;
+
+    request.set_search_by(SearchRequest::SEARCHBY_NAME_FUZZY);
+    request.set_search_logic(SearchRequest::SEARCHLOGIC_CONJUNCTIVE);
+    request.add_terms("pakman");
+    request.add_terms("packmann");
+    FillFieldMask(request.mutable_options(), {"name"});
+
+    auto status = service->Search(request, &response);
+    ASSERT_TRUE(status.ok()) << status.error_message();
+
+    EXPECT_THAT(response.packages(),
+                ElementsAre(Property(&Package::name, "packman"),
+                            Property(&Package::name, "pacman")));
+  }
+}
+
 TEST_F(ServiceImplTest, SearchWithFieldMask) {
   std::vector<Package> packages;
   {
@@ -1009,4 +1248,407 @@ TEST_F(ServiceImplTest, ResolveVersioned) {
                                      Property(&Package::name, "expac-git"))))));
 }
 
+TEST_F(ServiceImplTest, ParallelLoadPreservesStorageOrder) {
+  std::vector<Package> packages;
+  for (int i = 0; i < 100; ++i) {
+    auto& p = packages.emplace_back();
+    p.set_name(absl::StrCat("package-", i));
+  }
+
+  ServiceImpl::Options options;
+  options.load_threads = 4;
+  auto service = BuildService(packages, options);
+
+  SearchRequest request;
+  SearchResponse response;
+
+  request.set_search_by(SearchRequest::SEARCHBY_NAME);
+  request.set_search_logic(SearchRequest::SEARCHLOGIC_DISJUNCTIVE);
+  request.add_terms("*");
+  FillFieldMask(request.mutable_options(), {"name"});
+
+  auto status = service->Search(request, &response);
+  ASSERT_TRUE(status.ok()) << status.error_message();
+
+  std::vector<std::string> names;
+  for (const auto& p : response.packages()) {
+    names.push_back(p.name());
+  }
+
+  EXPECT_EQ(names, storage().List());
+}
+
+TEST_F(ServiceImplTest, ShardedSearchPreservesStorageOrder) {
+  std::vector<Package> packages;
+  for (int i = 0; i < 100; ++i) {
+    auto& p = packages.emplace_back();
+    p.set_name(absl::StrCat("package-", i));
+    p.set_description(i % 3 == 0 ? "fizz" : "buzz");
+  }
+
+  ServiceImpl::Options options;
+  options.search_threads = 3;
+  options.search_shard_size = 7;
+  auto service = BuildService(packages, options);
+
+  std::vector<std::string> expected;
+  for (const auto& name : storage().List()) {
+    int i;
+    ASSERT_TRUE(absl::SimpleAtoi(name.substr(name.find('-') + 1), &i));
+    if (i % 3 == 0) {
+      expected.push_back(name);
+    }
+  }
+
+  // Once over every package, and once over index candidates.
+  for (const char* term : {"*i*", "fizz*"}) {
+    SearchRequest request;
+    SearchResponse response;
+
+    request.set_search_by(SearchRequest::SEARCHBY_NAME_DESC);
+    request.set_search_logic(SearchRequest::SEARCHLOGIC_DISJUNCTIVE);
+    request.add_terms(term);
+    FillFieldMask(request.mutable_options(), {"name"});
+
+    auto status = service->Search(request, &response);
+    ASSERT_TRUE(status.ok()) << status.error_message();
+
+    std::vector<std::string> names;
+    for (const auto& p : response.packages()) {
+      names.push_back(p.name());
+    }
+
+    EXPECT_EQ(names, expected) << term;
+  }
+}
+
+TEST_F(ServiceImplTest, SearchPaginatesInOrder) {
+  std::vector<Package> packages;
+  for (int i = 0; i < 40; ++i) {
+    auto& p = packages.emplace_back();
+    p.set_name(absl::StrCat("Package-", i));
+    p.set_description(i % 2 == 0 ? "even" : "odd");
+    p.set_votes((i * 7) % 40);
+  }
+
+  ServiceImpl::Options options;
+  options.search_threads = 2;
+  options.search_shard_size = 6;
+  auto service = BuildService(packages, options);
+
+  // Every package, page by page, compared against the same search in a
+  // single page.
+  for (auto order_by :
+       {SearchRequest::ORDERBY_RELEVANCE, SearchRequest::ORDERBY_NAME,
+        SearchRequest::ORDERBY_VOTES}) {
+    SearchRequest request;
+    request.set_search_by(SearchRequest::SEARCHBY_NAME_DESC);
+    request.set_search_logic(SearchRequest::SEARCHLOGIC_DISJUNCTIVE);
+    request.set_order_by(order_by);
+    request.add_terms("*");
+    FillFieldMask(request.mutable_options(), {"name", "votes"});
+
+    SearchResponse all;
+    auto status = service->Search(request, &all);
+    ASSERT_TRUE(status.ok()) << status.error_message();
+    ASSERT_EQ(all.packages_size(), 40);
+    EXPECT_TRUE(all.next_page_token().empty());
+
+    std::vector<std::string> expected, names;
+    for (const auto& p : all.packages()) {
+      expected.push_back(p.name());
+    }
+
+    request.set_page_size(7);
+    for (int pages = 1;; ++pages) {
+      SearchResponse response;
+      status = service->Search(request, &response);
+      ASSERT_TRUE(status.ok()) << status.error_message();
+      ASSERT_LE(response.packages_size(), 7);
+      for (const auto& p : response.packages()) {
+        names.push_back(p.name());
+      }
+
+      if (response.next_page_token().empty()) {
+        EXPECT_EQ(pages, 6);
+        break;
+      }
+      request.set_page_token(response.next_page_token());
+    }
+
+    EXPECT_EQ(names, expected) << SearchRequest::OrderBy_Name(order_by);
+  }
+
+  {
+    SearchRequest request;
+    SearchResponse response;
+
+    request.set_search_by(SearchRequest::SEARCHBY_NAME);
+    request.set_search_logic(SearchRequest::SEARCHLOGIC_DISJUNCTIVE);
+    request.set_order_by(SearchRequest::ORDERBY_VOTES);
+    request.set_page_size(3);
+    request.add_terms("package-*");
+    FillFieldMask(request.mutable_options(), {"votes"});
+
+    auto status = service->Search(request, &response);
+    ASSERT_TRUE(status.ok()) << status.error_message();
+
+    EXPECT_THAT(response.packages(),
+                ElementsAre(Property(&Package::votes, 39),
+                            Property(&Package::votes, 38),
+                            Property(&Package::votes, 37)));
+  }
+}
+
+TEST_F(ServiceImplTest, SearchRejectsBadPageTokens) {
+  std::vector<Package> packages;
+  for (int i = 0; i < 5; ++i) {
+    auto& p = packages.emplace_back();
+    p.set_name(absl::StrCat("package-", i));
+  }
+  auto service = BuildService(packages);
+
+  SearchRequest request;
+  request.set_search_by(SearchRequest::SEARCHBY_NAME);
+  request.set_search_logic(SearchRequest::SEARCHLOGIC_DISJUNCTIVE);
+  request.set_page_size(2);
+  request.add_terms("package-*");
+
+  SearchResponse response;
+  auto status = service->Search(request, &response);
+  ASSERT_TRUE(status.ok()) << status.error_message();
+  ASSERT_FALSE(response.next_page_token().empty());
+  const std::string token = response.next_page_token();
+
+  {
+    // The token belongs to a different search.
+    SearchRequest other = request;
+    other.set_page_token(token);
+    other.set_order_by(SearchRequest::ORDERBY_NAME);
+    status = service->Search(other, &response);
+    EXPECT_EQ(status.error_code(), grpc::StatusCode::INVALID_ARGUMENT);
+
+    other.set_order_by(SearchRequest::ORDERBY_RELEVANCE);
+    other.set_page_token("garbage");
+    status = service->Search(other, &response);
+    EXPECT_EQ(status.error_code(), grpc::StatusCode::INVALID_ARGUMENT);
+
+    other.clear_page_token();
+    other.set_page_size(-1);
+    status = service->Search(other, &response);
+    EXPECT_EQ(status.error_code(), grpc::StatusCode::INVALID_ARGUMENT);
+  }
+
+  // Tokens only last as long as the snapshot they were issued for.
+  request.set_page_token(token);
+  status = service->Search(request, &response);
+  EXPECT_TRUE(status.ok()) << status.error_message();
+
+  service->Reload();
+  status = service->Search(request, &response);
+  EXPECT_EQ(status.error_code(), grpc::StatusCode::FAILED_PRECONDITION);
+}
+
+TEST_F(ServiceImplTest, IncrementalReload) {
+  std::vector<Package> packages;
+  {
+    auto& p = packages.emplace_back();
+    p.set_name("auracle-git");
+    p.add_maintainers("falconindy");
+  }
+  {
+    auto& p = packages.emplace_back();
+    p.set_name("pkgfile-git");
+    p.add_maintainers("falconindy");
+  }
+  {
+    auto& p = packages.emplace_back();
+    p.set_name("expac-git");
+    p.add_maintainers("falconindy");
+  }
+  for (int i = 0; i < 20; ++i) {
+    auto& p = packages.emplace_back();
+    p.set_name(absl::StrCat("filler-", i));
+    p.add_maintainers("someone");
+  }
+  auto service = BuildService(packages);
+
+  {
+    Package p;
+    p.set_name("pkgfile-git");
+    p.add_maintainers("dreisner");
+    AddPackage(p);
+  }
+  {
+    Package p;
+    p.set_name("pacman-git");
+    p.add_maintainers("falconindy");
+    AddPackage(p);
+  }
+  RemovePackage("expac-git");
+
+  service->Reload();
+
+  LookupRequest request;
+  LookupResponse response;
+
+  request.set_lookup_by(LookupRequest::LOOKUPBY_MAINTAINER);
+  request.add_names("falconindy");
+  request.add_names("dreisner");
+  request.add_names("someone");
+  FillFieldMask(request.mutable_options(), {"name", "maintainers"});
+
+  auto status = service->Lookup(request, &response);
+  ASSERT_TRUE(status.ok()) << status.error_message();
+
+  std::vector<testing::Matcher<const Package&>> expected = {
+      AllOf(Property(&Package::name, "auracle-git"),
+            Property(&Package::maintainers,
+                     UnorderedElementsAre("falconindy"))),
+      AllOf(Property(&Package::name, "pkgfile-git"),
+            Property(&Package::maintainers, UnorderedElementsAre("dreisner"))),
+      AllOf(Property(&Package::name, "pacman-git"),
+            Property(&Package::maintainers,
+                     UnorderedElementsAre("falconindy"))),
+  };
+  for (int i = 0; i < 20; ++i) {
+    expected.push_back(Property(&Package::name, absl::StrCat("filler-", i)));
+  }
+
+  EXPECT_THAT(response.packages(), UnorderedElementsAreArray(expected));
+  EXPECT_THAT(response.not_found_names(), testing::IsEmpty());
+
+  request.Clear();
+  response.Clear();
+
+  request.set_lookup_by(LookupRequest::LOOKUPBY_NAME);
+  request.add_names("expac-git");
+  FillFieldMask(request.mutable_options(), {"name"});
+
+  status = service->Lookup(request, &response);
+  ASSERT_TRUE(status.ok()) << status.error_message();
+
+  EXPECT_THAT(response.packages(), testing::IsEmpty());
+  EXPECT_THAT(response.not_found_names(), UnorderedElementsAre("expac-git"));
+}
+
+TEST(ServiceImplPackedStorageTest, LookupFromPackedStorage) {
+  TemporaryDirectory tempdir;
+  const std::string dbpath = tempdir.dirpath() / "packed.db";
+
+  PackedStorageBuilder builder;
+  {
+    Package p;
+    p.set_name("auracle-git");
+    p.set_pkgbase("auracle");
+    builder.Add(p.name(), p.SerializeAsString());
+  }
+  {
+    Package p;
+    p.set_name("pkgfile-git");
+    p.set_pkgbase("pkgfile");
+    builder.Add(p.name(), p.SerializeAsString());
+  }
+  ASSERT_TRUE(builder.Write(dbpath));
+
+  PackedStorage storage(dbpath);
+  ServiceImpl service(&storage);
+
+  LookupRequest request;
+  LookupResponse response;
+
+  request.set_lookup_by(LookupRequest::LOOKUPBY_PKGBASE);
+  request.add_names("auracle");
+  request.add_names("pkgfile");
+  FillFieldMask(request.mutable_options(), {"name"});
+
+  auto status = service.Lookup(request, &response);
+  ASSERT_TRUE(status.ok()) << status.error_message();
+
+  EXPECT_THAT(response.packages(),
+              UnorderedElementsAre(Property(&Package::name, "auracle-git"),
+                                   Property(&Package::name, "pkgfile-git")));
+}
+
+TEST(ServiceImplPackedStorageTest, ServesPrebuiltIndexes) {
+  TemporaryDirectory tempdir;
+  const std::string dbdir = tempdir.dirpath() / "db";
+  const std::string dbpath = tempdir.dirpath() / "image.db";
+  fs::create_directory(dbdir);
+
+  {
+    Package p;
+    p.set_name("auracle-git");
+    p.set_pkgbase("auracle");
+    p.add_provides("auracle=1.0");
+    aur_storage::SetBinaryProto(fs::path(dbdir) / p.name(), p);
+  }
+  {
+    Package p;
+    p.set_name("pkgfile-git");
+    p.set_pkgbase("pkgfile");
+    p.add_maintainers("falconindy");
+    aur_storage::SetBinaryProto(fs::path(dbdir) / p.name(), p);
+  }
+
+  const FilesystemStorage source(dbdir);
+  ASSERT_TRUE(
+      ServiceImpl::WriteIndexImage(&source, dbpath, ServiceImpl::Options()));
+
+  PackedStorage storage(dbpath);
+  std::string_view section;
+  std::shared_ptr<const void> pin;
+  ASSERT_TRUE(storage.GetSection("index/pkgbase", &section, &pin));
+
+  ServiceImpl service(&storage);
+
+  {
+    LookupRequest request;
+    LookupResponse response;
+    request.set_lookup_by(LookupRequest::LOOKUPBY_PKGBASE);
+    request.add_names("auracle");
+    request.add_names("pkgfile");
+    request.add_names("notfound");
+    FillFieldMask(request.mutable_options(), {"name"});
+
+    auto status = service.Lookup(request, &response);
+    ASSERT_TRUE(status.ok()) << status.error_message();
+
+    EXPECT_THAT(response.packages(),
+                UnorderedElementsAre(Property(&Package::name, "auracle-git"),
+                                     Property(&Package::name, "pkgfile-git")));
+    EXPECT_THAT(response.not_found_names(), UnorderedElementsAre("notfound"));
+  }
+
+  {
+    ResolveRequest request;
+    ResolveResponse response;
+    request.add_depstrings("auracle>=1");
+    FillFieldMask(request.mutable_options(), {"name"});
+
+    auto status = service.Resolve(request, &response);
+    ASSERT_TRUE(status.ok()) << status.error_message();
+
+    ASSERT_EQ(response.resolved_packages_size(), 1);
+    EXPECT_THAT(response.resolved_packages(0).providers(),
+                UnorderedElementsAre(Property(&Package::name, "auracle-git")));
+  }
+
+  // The search index isn't part of the image, but is built all the same.
+  {
+    SearchRequest request;
+    SearchResponse response;
+    request.set_search_by(SearchRequest::SEARCHBY_NAME);
+    request.set_search_logic(SearchRequest::SEARCHLOGIC_DISJUNCTIVE);
+    request.add_terms("*file*");
+    FillFieldMask(request.mutable_options(), {"name"});
+
+    auto status = service.Search(request, &response);
+    ASSERT_TRUE(status.ok()) << status.error_message();
+
+    EXPECT_THAT(response.packages(),
+                ElementsAre(Property(&Package::name, "pkgfile-git")));
+  }
+}
+
 }  // namespace
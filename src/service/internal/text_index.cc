@@ -0,0 +1,217 @@
+#include "service/internal/text_index.hh"
+
+#include <algorithm>
+#include <cmath>
+
+#include "absl/algorithm/container.h"
+#include "service/internal/ascii.hh"
+
+namespace aur_internal {
+
+namespace {
+
+// How much a single occurrence of a word counts for in each field.
+constexpr float kNameWeight = 3;
+constexpr float kKeywordWeight = 2;
+constexpr float kDescriptionWeight = 1;
+
+// The usual BM25 parameters: k1 bounds how much repeating a word can add, and
+// b sets how strongly scores are normalized by length.
+constexpr double kK1 = 1.2;
+constexpr double kB = 0.75;
+
+// Boosts grow logarithmically, so that popular packages are favored without
+// burying relevant but obscure ones.
+constexpr double kVotesBoost = 0.05;
+constexpr double kPopularityBoost = 0.1;
+
+bool IsWordByte(char c) {
+  const unsigned char u = c;
+  return (u >= 'a' && u <= 'z') || (u >= 'A' && u <= 'Z') ||
+         (u >= '0' && u <= '9') || u >= 0x80;
+}
+
+}  // namespace
+
+// static
+void TextIndex::Tokenize(std::string_view text,
+                         std::vector<std::string>* words) {
+  for (size_t i = 0; i < text.size();) {
+    if (!IsWordByte(text[i])) {
+      ++i;
+      continue;
+    }
+
+    size_t end = i;
+    while (end < text.size() && IsWordByte(text[end])) {
+      ++end;
+    }
+
+    std::string& word = words->emplace_back(text.substr(i, end - i));
+    AsciiToLower(word.data(), word.size(), word.data());
+    i = end;
+  }
+}
+
+// static
+TextIndex TextIndex::Build(const std::vector<const Package*>& packages) {
+  TextIndex index;
+  index.lengths_.reserve(packages.size());
+  index.boosts_.reserve(packages.size());
+
+  std::vector<std::pair<uint32_t, Posting>> entries;
+  absl::flat_hash_map<uint32_t, float> frequencies;
+  std::vector<std::string> words;
+  double total_length = 0;
+  for (uint32_t position = 0; position < packages.size(); ++position) {
+    const Package& package = *packages[position];
+
+    frequencies.clear();
+    float length = 0;
+    auto add = [&](std::string_view text, float weight) {
+      words.clear();
+      Tokenize(text, &words);
+      for (const std::string& word : words) {
+        auto [iter, inserted] = index.ids_.try_emplace(word, index.ids_.size());
+        frequencies[iter->second] += weight;
+        length += weight;
+      }
+    };
+
+    add(package.name(), kNameWeight);
+    for (const std::string& keyword : package.keywords()) {
+      add(keyword, kKeywordWeight);
+    }
+    add(package.description(), kDescriptionWeight);
+
+    for (const auto& [id, frequency] : frequencies) {
+      entries.emplace_back(id, Posting{position, frequency});
+    }
+
+    index.lengths_.push_back(length);
+    total_length += length;
+
+    index.boosts_.push_back(
+        1 + kVotesBoost * std::log1p(std::max(0, package.votes())) +
+        kPopularityBoost * std::log1p(std::max(0.0, package.popularity())));
+  }
+
+  if (!packages.empty()) {
+    index.average_length_ = total_length / packages.size();
+  }
+
+  // Packages are visited in order, so a counting sort of the postings by word
+  // leaves every posting list sorted.
+  index.offsets_.assign(index.ids_.size() + 1, 0);
+  for (const auto& [id, posting] : entries) {
+    ++index.offsets_[id + 1];
+  }
+  for (size_t i = 1; i < index.offsets_.size(); ++i) {
+    index.offsets_[i] += index.offsets_[i - 1];
+  }
+
+  index.postings_.resize(entries.size());
+  std::vector<uint32_t> next(index.offsets_.begin(), index.offsets_.end() - 1);
+  for (const auto& [id, posting] : entries) {
+    index.postings_[next[id]++] = posting;
+  }
+
+  return index;
+}
+
+std::vector<TextIndex::Result> TextIndex::Search(
+    const std::vector<std::string>& words, bool conjunctive,
+    size_t limit) const {
+  struct Term {
+    const Posting* begin;
+    const Posting* end;
+    double idf;
+  };
+
+  const double num_packages = lengths_.size();
+  std::vector<Term> terms;
+  std::vector<uint32_t> seen;
+  for (const std::string& word : words) {
+    auto iter = ids_.find(word);
+    if (iter == ids_.end()) {
+      if (conjunctive) {
+        return {};
+      }
+      continue;
+    }
+
+    const uint32_t id = iter->second;
+    if (absl::c_linear_search(seen, id)) {
+      continue;
+    }
+    seen.push_back(id);
+
+    const Posting* begin = postings_.data() + offsets_[id];
+    const Posting* end = postings_.data() + offsets_[id + 1];
+    const double df = end - begin;
+    terms.push_back(
+        {begin, end, std::log(1 + (num_packages - df + 0.5) / (df + 0.5))});
+  }
+
+  // Scores are accumulated a word at a time. When every word is required,
+  // only packages holding the rarest word can match, so the others only add
+  // to packages that are already there.
+  absl::c_sort(terms, [](const Term& a, const Term& b) {
+    return a.end - a.begin < b.end - b.begin;
+  });
+
+  struct Accumulator {
+    double score = 0;
+    uint32_t terms = 0;
+  };
+
+  absl::flat_hash_map<uint32_t, Accumulator> accumulators;
+  for (size_t t = 0; t < terms.size(); ++t) {
+    const Term& term = terms[t];
+    for (const Posting* p = term.begin; p != term.end; ++p) {
+      Accumulator* accumulator;
+      if (conjunctive && t > 0) {
+        auto iter = accumulators.find(p->position);
+        if (iter == accumulators.end()) {
+          continue;
+        }
+        accumulator = &iter->second;
+      } else {
+        accumulator = &accumulators[p->position];
+      }
+
+      const double tf = p->frequency;
+      const double norm =
+          kK1 * (1 - kB + kB * lengths_[p->position] / average_length_);
+      accumulator->score += term.idf * tf * (kK1 + 1) / (tf + norm);
+      ++accumulator->terms;
+    }
+  }
+
+  // Keep the best |limit| results in a heap whose top is the worst of them.
+  auto before = [](const Result& a, const Result& b) {
+    return a.score != b.score ? a.score > b.score : a.position < b.position;
+  };
+
+  std::vector<Result> results;
+  for (const auto& [position, accumulator] : accumulators) {
+    if (conjunctive && accumulator.terms < terms.size()) {
+      continue;
+    }
+
+    const Result result{position, accumulator.score * boosts_[position]};
+    if (limit == 0 || results.size() < limit) {
+      results.push_back(result);
+      std::push_heap(results.begin(), results.end(), before);
+    } else if (before(result, results.front())) {
+      std::pop_heap(results.begin(), results.end(), before);
+      results.back() = result;
+      std::push_heap(results.begin(), results.end(), before);
+    }
+  }
+
+  std::sort_heap(results.begin(), results.end(), before);
+  return results;
+}
+
+}  // namespace aur_internal
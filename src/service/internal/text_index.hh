@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "aur_internal.pb.h"
+
+namespace aur_internal {
+
+// TextIndex is an inverted index over the words of package names, keywords
+// and descriptions, for searching by words rather than by globs. Packages are
+// identified by their position in the list that the index was built from.
+//
+// Text is split into words at every ASCII character other than a letter or a
+// digit, and words are lowercased, so "Python-Requests" holds the words
+// "python" and "requests". Bytes outside of ASCII are kept as part of words.
+//
+// Matches are ranked with BM25, where a word counts for more in a name than in
+// a keyword, and for more in a keyword than in a description. Scores are then
+// boosted by the package's votes and popularity, so that among equally
+// relevant packages the ones people actually use come first.
+class TextIndex final {
+ public:
+  struct Result {
+    uint32_t position;
+    double score;
+  };
+
+  TextIndex() = default;
+
+  static TextIndex Build(const std::vector<const Package*>& packages);
+
+  TextIndex(TextIndex&&) = default;
+  TextIndex& operator=(TextIndex&&) = default;
+
+  TextIndex(const TextIndex&) = delete;
+  TextIndex& operator=(const TextIndex&) = delete;
+
+  // Appends the lowercased words of |text| to |words|.
+  static void Tokenize(std::string_view text, std::vector<std::string>* words);
+
+  // Returns up to |limit| of the packages containing all of |words| when
+  // |conjunctive| is set, or any of them otherwise, best first. Packages with
+  // equal scores are ordered by position. A |limit| of 0 returns every match.
+  std::vector<Result> Search(const std::vector<std::string>& words,
+                             bool conjunctive, size_t limit) const;
+
+ private:
+  struct Posting {
+    uint32_t position;
+
+    // Occurrences of the word in the package, weighted by field.
+    float frequency;
+  };
+
+  absl::flat_hash_map<std::string, uint32_t> ids_;
+
+  // Postings of the word with id i span [offsets_[i], offsets_[i + 1]) of
+  // postings_, in ascending order of position.
+  std::vector<uint32_t> offsets_;
+  std::vector<Posting> postings_;
+
+  // Weighted number of words in each package, and the average over all of
+  // them.
+  std::vector<float> lengths_;
+  double average_length_ = 0;
+
+  // Factor applied to the score of each package for its votes and
+  // popularity.
+  std::vector<float> boosts_;
+};
+
+}  // namespace aur_internal
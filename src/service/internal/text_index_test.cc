@@ -0,0 +1,97 @@
+#include "service/internal/text_index.hh"
+
+#include <string>
+#include <vector>
+
+#include "aur_internal.pb.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using aur_internal::Package;
+using aur_internal::TextIndex;
+using testing::ElementsAre;
+using testing::IsEmpty;
+using testing::UnorderedElementsAre;
+
+namespace {
+
+class TextIndexTest : public testing::Test {
+ protected:
+  TextIndexTest() {
+    auto add = [&](const std::string& name, const std::string& description,
+                   int votes, std::vector<std::string> keywords = {}) {
+      auto& p = packages_.emplace_back();
+      p.set_name(name);
+      p.set_description(description);
+      p.set_votes(votes);
+      for (auto& keyword : keywords) {
+        p.add_keywords(std::move(keyword));
+      }
+    };
+
+    add("python-requests", "Python HTTP for Humans", 100);
+    add("python2-requests", "Python HTTP for Humans (legacy)", 1);
+    add("curl-git", "Command line tool for transferring data with URLs", 10,
+        {"http"});
+    add("pacman-git", "A library-based package manager", 0);
+    add("expac", "pacman database extraction utility", 50);
+
+    for (const auto& p : packages_) {
+      pointers_.push_back(&p);
+    }
+    index_ = TextIndex::Build(pointers_);
+  }
+
+  std::vector<uint32_t> Search(const std::vector<std::string>& words,
+                               bool conjunctive, size_t limit = 0) const {
+    std::vector<uint32_t> positions;
+    for (const auto& result : index_.Search(words, conjunctive, limit)) {
+      positions.push_back(result.position);
+    }
+    return positions;
+  }
+
+  std::vector<Package> packages_;
+  std::vector<const Package*> pointers_;
+  TextIndex index_;
+};
+
+TEST(TextIndexTokenizeTest, SplitsAndLowercases) {
+  std::vector<std::string> words;
+  TextIndex::Tokenize("Python-Requests: HTTP for *humans*, v2.0", &words);
+  EXPECT_THAT(words, ElementsAre("python", "requests", "http", "for",
+                                 "humans", "v2", "0"));
+
+  words.clear();
+  TextIndex::Tokenize("", &words);
+  TextIndex::Tokenize(" -*- ", &words);
+  EXPECT_THAT(words, IsEmpty());
+}
+
+TEST_F(TextIndexTest, DisjunctiveAndConjunctive) {
+  EXPECT_THAT(Search({"pacman", "requests"}, false),
+              UnorderedElementsAre(0, 1, 3, 4));
+  EXPECT_THAT(Search({"pacman", "git"}, true), ElementsAre(3));
+  EXPECT_THAT(Search({"pacman", "nonexistent"}, true), IsEmpty());
+  EXPECT_THAT(Search({"nonexistent"}, false), IsEmpty());
+  EXPECT_THAT(Search({}, false), IsEmpty());
+}
+
+TEST_F(TextIndexTest, RanksByRelevanceThenPopularity) {
+  // A name match outranks a description match.
+  EXPECT_THAT(Search({"pacman"}, false), ElementsAre(3, 4));
+
+  // Equally relevant, so the package with more votes comes first.
+  EXPECT_THAT(Search({"python"}, false), ElementsAre(0, 1));
+
+  // The keyword counts for more than the mentions in descriptions.
+  EXPECT_THAT(Search({"http"}, false), ElementsAre(2, 0, 1));
+}
+
+TEST_F(TextIndexTest, LimitKeepsTheBest) {
+  EXPECT_THAT(Search({"http"}, false, 1), ElementsAre(2));
+  EXPECT_THAT(Search({"http"}, false, 2), ElementsAre(2, 0));
+  EXPECT_THAT(Search({"http"}, false, 10), ElementsAre(2, 0, 1));
+}
+
+}  // namespace
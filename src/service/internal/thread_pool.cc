@@ -0,0 +1,113 @@
+#include "service/internal/thread_pool.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#include "util/parallel.hh"
+
+namespace aur_internal {
+
+namespace {
+
+// Shared between the caller of ParallelFor() and the pool threads helping it.
+// Helpers may only get to run after the caller has returned, so they hold
+// this by shared_ptr and only touch |fn| after claiming an index.
+struct ParallelForState {
+  ParallelForState(size_t n, const std::function<void(size_t)>* fn)
+      : n(n), fn(fn) {}
+
+  // Claims and runs invocations until there are none left.
+  void Run() {
+    size_t ran = 0;
+    for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < n;
+         ++ran) {
+      (*fn)(i);
+    }
+
+    if (ran > 0) {
+      absl::MutexLock l(&mutex);
+      done += ran;
+    }
+  }
+
+  const size_t n;
+  const std::function<void(size_t)>* const fn;
+  std::atomic<size_t> next{0};
+
+  absl::Mutex mutex;
+  size_t done ABSL_GUARDED_BY(mutex) = 0;
+};
+
+}  // namespace
+
+ThreadPool::ThreadPool(int num_threads) {
+  num_threads = aur_util::ResolveThreadCount(num_threads);
+  threads_.reserve(num_threads);
+  for (int i = 0; i < num_threads; ++i) {
+    threads_.emplace_back(&ThreadPool::WorkLoop, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    absl::MutexLock l(&mutex_);
+    stopping_ = true;
+  }
+
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+void ThreadPool::Schedule(std::function<void()> fn) {
+  absl::MutexLock l(&mutex_);
+  queue_.push_back(std::move(fn));
+}
+
+void ThreadPool::ParallelFor(size_t n,
+                             const std::function<void(size_t)>& fn) {
+  if (n == 0) {
+    return;
+  }
+
+  auto state = std::make_shared<ParallelForState>(n, &fn);
+
+  const size_t helpers = std::min(n - 1, threads_.size());
+  for (size_t i = 0; i < helpers; ++i) {
+    Schedule([state] { state->Run(); });
+  }
+
+  state->Run();
+
+  absl::MutexLock l(&state->mutex);
+  state->mutex.Await(absl::Condition(
+      +[](ParallelForState* state) { return state->done == state->n; },
+      state.get()));
+}
+
+void ThreadPool::WorkLoop() {
+  for (;;) {
+    std::function<void()> fn;
+    {
+      absl::MutexLock l(&mutex_);
+      mutex_.Await(absl::Condition(
+          +[](ThreadPool* pool) {
+            return pool->stopping_ || !pool->queue_.empty();
+          },
+          this));
+
+      // Work that was scheduled before stopping still runs.
+      if (queue_.empty()) {
+        return;
+      }
+
+      fn = std::move(queue_.front());
+      queue_.pop_front();
+    }
+
+    fn();
+  }
+}
+
+}  // namespace aur_internal
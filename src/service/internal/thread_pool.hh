@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+
+namespace aur_internal {
+
+// ThreadPool runs work on a fixed set of threads. The number of threads is an
+// upper bound on the CPU time that work submitted to the pool can take away
+// from everything else in the process.
+class ThreadPool final {
+ public:
+  // Starts |num_threads| threads. A non-positive count selects the number of
+  // available CPUs.
+  explicit ThreadPool(int num_threads);
+
+  // Waits for all scheduled work to finish.
+  ~ThreadPool();
+
+  ThreadPool(ThreadPool&&) = delete;
+  ThreadPool& operator=(ThreadPool&&) = delete;
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  size_t num_threads() const { return threads_.size(); }
+
+  // Runs |fn| on one of the pool's threads.
+  void Schedule(std::function<void()> fn);
+
+  // Invokes fn(i) for every i in [0, n), and returns once all invocations
+  // have completed. The calling thread takes part rather than blocking, so
+  // this makes progress even when every thread in the pool is busy, and may
+  // be called from many threads at once.
+  void ParallelFor(size_t n, const std::function<void(size_t)>& fn);
+
+ private:
+  void WorkLoop();
+
+  absl::Mutex mutex_;
+  std::deque<std::function<void()>> queue_ ABSL_GUARDED_BY(mutex_);
+  bool stopping_ ABSL_GUARDED_BY(mutex_) = false;
+
+  std::vector<std::thread> threads_;
+};
+
+}  // namespace aur_internal
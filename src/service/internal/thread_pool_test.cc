@@ -0,0 +1,79 @@
+#include "service/internal/thread_pool.hh"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "absl/synchronization/notification.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using aur_internal::ThreadPool;
+
+namespace {
+
+TEST(ThreadPoolTest, ParallelForVisitsEveryIndexOnce) {
+  ThreadPool pool(4);
+  EXPECT_EQ(pool.num_threads(), 4);
+
+  for (size_t n : {0, 1, 2, 3, 100, 10000}) {
+    std::vector<std::atomic<int>> visits(n);
+    pool.ParallelFor(n, [&](size_t i) { visits[i].fetch_add(1); });
+
+    for (size_t i = 0; i < n; ++i) {
+      EXPECT_EQ(visits[i].load(), 1) << "n=" << n << " i=" << i;
+    }
+  }
+}
+
+TEST(ThreadPoolTest, ParallelForProgressesWhenPoolIsBusy) {
+  ThreadPool pool(2);
+
+  absl::Notification release;
+  for (size_t i = 0; i < pool.num_threads(); ++i) {
+    pool.Schedule([&] { release.WaitForNotification(); });
+  }
+
+  // Every pool thread is blocked, so the caller has to do all of the work.
+  std::atomic<int> sum{0};
+  pool.ParallelFor(100, [&](size_t i) { sum.fetch_add(i); });
+  EXPECT_EQ(sum.load(), 4950);
+
+  release.Notify();
+}
+
+TEST(ThreadPoolTest, ConcurrentCallers) {
+  ThreadPool pool(3);
+
+  std::vector<std::atomic<int>> sums(8);
+  std::vector<std::thread> callers;
+  for (size_t caller = 0; caller < sums.size(); ++caller) {
+    callers.emplace_back([&, caller] {
+      for (int round = 0; round < 20; ++round) {
+        pool.ParallelFor(50, [&](size_t i) { sums[caller].fetch_add(i); });
+      }
+    });
+  }
+
+  for (auto& caller : callers) {
+    caller.join();
+  }
+
+  for (const auto& sum : sums) {
+    EXPECT_EQ(sum.load(), 20 * 1225);
+  }
+}
+
+TEST(ThreadPoolTest, DestructorRunsScheduledWork) {
+  std::atomic<int> ran{0};
+  {
+    ThreadPool pool(1);
+    for (int i = 0; i < 10; ++i) {
+      pool.Schedule([&] { ran.fetch_add(1); });
+    }
+  }
+
+  EXPECT_EQ(ran.load(), 10);
+}
+
+}  // namespace
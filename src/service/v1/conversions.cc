@@ -56,6 +56,7 @@ SearchResponse ToV1Response(aur_internal::SearchResponse response) {
   SearchResponse v1;
 
   *v1.mutable_packages() = ToV1Packages(response.mutable_packages());
+  v1.set_allocated_next_page_token(response.release_next_page_token());
 
   return v1;
 }
@@ -112,6 +113,12 @@ aur_internal::SearchRequest ToInternalRequest(const SearchRequest& request) {
     case SearchRequest::SEARCHBY_NAME:
       internal.set_search_by(aur_internal::SearchRequest::SEARCHBY_NAME);
       break;
+    case SearchRequest::SEARCHBY_WORDS:
+      internal.set_search_by(aur_internal::SearchRequest::SEARCHBY_WORDS);
+      break;
+    case SearchRequest::SEARCHBY_NAME_FUZZY:
+      internal.set_search_by(aur_internal::SearchRequest::SEARCHBY_NAME_FUZZY);
+      break;
     default:
       // idk, return an error?
       internal.set_search_by(aur_internal::SearchRequest::SEARCHBY_UNKNOWN);
@@ -135,6 +142,35 @@ aur_internal::SearchRequest ToInternalRequest(const SearchRequest& request) {
       break;
   }
 
+  switch (request.order_by()) {
+    case SearchRequest::ORDERBY_UNKNOWN:
+    case SearchRequest::ORDERBY_RELEVANCE:
+      internal.set_order_by(aur_internal::SearchRequest::ORDERBY_RELEVANCE);
+      break;
+    case SearchRequest::ORDERBY_NAME:
+      internal.set_order_by(aur_internal::SearchRequest::ORDERBY_NAME);
+      break;
+    case SearchRequest::ORDERBY_VOTES:
+      internal.set_order_by(aur_internal::SearchRequest::ORDERBY_VOTES);
+      break;
+    case SearchRequest::ORDERBY_POPULARITY:
+      internal.set_order_by(aur_internal::SearchRequest::ORDERBY_POPULARITY);
+      break;
+    case SearchRequest::ORDERBY_MODIFIED:
+      internal.set_order_by(aur_internal::SearchRequest::ORDERBY_MODIFIED);
+      break;
+    default:
+      // Passed through as is, so that the request is refused rather than
+      // silently ordered some other way.
+      internal.set_order_by(
+          static_cast<aur_internal::SearchRequest::OrderBy>(
+              request.order_by()));
+      break;
+  }
+
+  internal.set_page_size(request.page_size());
+  internal.set_page_token(request.page_token());
+
   return internal;
 }
 
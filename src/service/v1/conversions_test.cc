@@ -49,6 +49,37 @@ TEST(ConversionsTest, SetsDefaultSearchLogic) {
             aur_internal::SearchRequest::SEARCHLOGIC_DISJUNCTIVE);
 }
 
+TEST(ConversionsTest, SetsDefaultOrderBy) {
+  v1::SearchRequest request;
+  request.add_terms("blah");
+
+  auto internal_request = ToInternalRequest(request);
+
+  EXPECT_EQ(internal_request.order_by(),
+            aur_internal::SearchRequest::ORDERBY_RELEVANCE);
+}
+
+TEST(ConversionsTest, CopiesPagination) {
+  v1::SearchRequest request;
+  request.add_terms("blah");
+  request.set_order_by(v1::SearchRequest::ORDERBY_VOTES);
+  request.set_page_size(50);
+  request.set_page_token("token");
+
+  auto internal_request = ToInternalRequest(request);
+
+  EXPECT_EQ(internal_request.order_by(),
+            aur_internal::SearchRequest::ORDERBY_VOTES);
+  EXPECT_EQ(internal_request.page_size(), 50);
+  EXPECT_EQ(internal_request.page_token(), "token");
+
+  aur_internal::SearchResponse internal_response;
+  internal_response.set_next_page_token("next");
+
+  EXPECT_EQ(v1::ToV1Response(std::move(internal_response)).next_page_token(),
+            "next");
+}
+
 TEST(ConversionsTest, AddsDefaultFieldMaskForLookup) {
   v1::LookupRequest request;
   request.add_names("blah");
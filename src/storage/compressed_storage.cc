@@ -0,0 +1,282 @@
+#include "storage/compressed_storage.hh"
+
+#define ZDICT_STATIC_LINKING_ONLY
+#include <zdict.h>
+#include <zstd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include "util/parallel.hh"
+
+namespace aur_storage {
+
+namespace {
+
+// The zstd CLI's default dictionary size. Our records are small enough that a
+// larger dictionary doesn't buy much.
+constexpr size_t kMaxDictionarySize = 112640;
+
+// Upper bound on the amount of data that we train the dictionary on. Larger
+// corpora are sampled evenly.
+constexpr size_t kMaxTrainingBytes = 32 << 20;
+
+// Upper bound on the size of a decompressed record. Packages are a few
+// kilobytes at most, and the size in a frame's header is only a claim, so a
+// corrupt record mustn't be able to make us allocate more than this.
+constexpr unsigned long long kMaxRecordSize = 16 << 20;
+
+struct DCtxDeleter {
+  void operator()(ZSTD_DCtx* dctx) const { ZSTD_freeDCtx(dctx); }
+};
+
+struct CCtxDeleter {
+  void operator()(ZSTD_CCtx* cctx) const { ZSTD_freeCCtx(cctx); }
+};
+
+struct CDictDeleter {
+  void operator()(ZSTD_CDict* cdict) const { ZSTD_freeCDict(cdict); }
+};
+
+// Decompression contexts carry a sizeable amount of scratch space, so keep one
+// around per thread rather than creating one per record.
+ZSTD_DCtx* ThreadLocalDCtx() {
+  thread_local std::unique_ptr<ZSTD_DCtx, DCtxDeleter> dctx(ZSTD_createDCtx());
+  return dctx.get();
+}
+
+// Likewise for compression, where each worker compressing records gets its
+// own context.
+ZSTD_CCtx* ThreadLocalCCtx() {
+  thread_local std::unique_ptr<ZSTD_CCtx, CCtxDeleter> cctx(ZSTD_createCCtx());
+  return cctx.get();
+}
+
+// Trains a dictionary on |records| for compressing at |level|, across
+// |num_threads| threads. Returns an empty dictionary if there isn't enough
+// data to train on.
+std::string TrainDictionary(
+    const std::vector<std::pair<std::string, std::string>>& records,
+    int level, int num_threads) {
+  size_t total_bytes = 0;
+  for (const auto& [key, value] : records) {
+    total_bytes += value.size();
+  }
+
+  const size_t stride = total_bytes / kMaxTrainingBytes + 1;
+
+  std::string samples;
+  std::vector<size_t> sample_sizes;
+  for (size_t i = 0; i < records.size(); i += stride) {
+    samples.append(records[i].second);
+    sample_sizes.push_back(records[i].second.size());
+  }
+
+  // zstd recommends training on roughly 100 times the dictionary size.
+  std::string dictionary(
+      std::min(kMaxDictionarySize, samples.size() / 100), '\0');
+
+  // The same parameters as ZDICT_trainFromBuffer(), which can't use more
+  // than one thread.
+  ZDICT_fastCover_params_t params;
+  memset(&params, 0, sizeof(params));
+  params.d = 8;
+  params.steps = 4;
+  params.nbThreads = aur_util::ResolveThreadCount(num_threads);
+  params.zParams.compressionLevel = level;
+
+  const size_t size = ZDICT_optimizeTrainFromBuffer_fastCover(
+      dictionary.data(), dictionary.size(), samples.data(),
+      sample_sizes.data(), static_cast<unsigned>(sample_sizes.size()),
+      &params);
+  if (ZDICT_isError(size)) {
+    return {};
+  }
+
+  dictionary.resize(size);
+  return dictionary;
+}
+
+}  // namespace
+
+class CompressedStorage::Dictionary {
+ public:
+  // An empty |data| means that records were compressed without a dictionary.
+  explicit Dictionary(std::string_view data) {
+    if (!data.empty()) {
+      ddict_ = ZSTD_createDDict(data.data(), data.size());
+      valid_ = ddict_ != nullptr;
+    }
+  }
+
+  ~Dictionary() { ZSTD_freeDDict(ddict_); }
+
+  Dictionary(Dictionary&&) = delete;
+  Dictionary& operator=(Dictionary&&) = delete;
+
+  Dictionary(const Dictionary&) = delete;
+  Dictionary& operator=(const Dictionary&) = delete;
+
+  bool valid() const { return valid_; }
+
+  bool Decompress(std::string_view compressed, std::string* value) const {
+    const unsigned long long size =
+        ZSTD_getFrameContentSize(compressed.data(), compressed.size());
+    if (!valid_ || size == ZSTD_CONTENTSIZE_ERROR ||
+        size == ZSTD_CONTENTSIZE_UNKNOWN || size > kMaxRecordSize) {
+      return false;
+    }
+
+    value->resize(size);
+
+    ZSTD_DCtx* dctx = ThreadLocalDCtx();
+    const size_t n =
+        ddict_ != nullptr
+            ? ZSTD_decompress_usingDDict(dctx, value->data(), value->size(),
+                                         compressed.data(), compressed.size(),
+                                         ddict_)
+            : ZSTD_decompressDCtx(dctx, value->data(), value->size(),
+                                  compressed.data(), compressed.size());
+
+    return !ZSTD_isError(n) && n == size;
+  }
+
+ private:
+  // ZSTD_DDict is safe to share between threads for decompression.
+  ZSTD_DDict* ddict_ = nullptr;
+  bool valid_ = true;
+};
+
+CompressedStorage::CompressedStorage(std::unique_ptr<Storage> storage)
+    : storage_(std::move(storage)) {
+  LoadDictionary();
+}
+
+CompressedStorage::~CompressedStorage() = default;
+
+std::shared_ptr<const CompressedStorage::Dictionary>
+CompressedStorage::dictionary() const {
+  absl::ReaderMutexLock l(&mutex_);
+  return dictionary_;
+}
+
+void CompressedStorage::LoadDictionary() const {
+  std::shared_ptr<const Dictionary> dictionary;
+
+  std::string_view data;
+  std::shared_ptr<const void> pin;
+  if (storage_->GetSection(kDictionarySection, &data, &pin)) {
+    dictionary = std::make_shared<const Dictionary>(data);
+    if (!dictionary->valid()) {
+      std::cerr << "error: failed to load compression dictionary\n";
+    }
+  }
+
+  absl::WriterMutexLock l(&mutex_);
+  dictionary_ = std::move(dictionary);
+}
+
+bool CompressedStorage::Get(const std::string& key, std::string* value) const {
+  const auto dictionary = this->dictionary();
+  if (dictionary == nullptr) {
+    return storage_->Get(key, value);
+  }
+
+  std::string_view compressed;
+  std::string buffer;
+  if (!storage_->GetView(key, &compressed)) {
+    if (!storage_->Get(key, &buffer)) {
+      return false;
+    }
+    compressed = buffer;
+  }
+
+  return dictionary->Decompress(compressed, value);
+}
+
+bool CompressedStorage::GetView(const std::string& key,
+                                std::string_view* value) const {
+  // Compressed records have no stable view to give out.
+  return dictionary() == nullptr && storage_->GetView(key, value);
+}
+
+bool CompressedStorage::Fingerprint(const std::string& key,
+                                    uint64_t* fingerprint) const {
+  // The compressed form changes whenever the record does, and the dictionary
+  // can't change without the records being rewritten.
+  return storage_->Fingerprint(key, fingerprint);
+}
+
+bool CompressedStorage::GetSection(const std::string& name,
+                                   std::string_view* data,
+                                   std::shared_ptr<const void>* pin) const {
+  return storage_->GetSection(name, data, pin);
+}
+
+std::vector<std::string> CompressedStorage::List() const {
+  auto keys = storage_->List();
+  LoadDictionary();
+  return keys;
+}
+
+void CompressedStorageBuilder::Add(std::string key, std::string value) {
+  records_.emplace_back(std::move(key), std::move(value));
+}
+
+bool CompressedStorageBuilder::Write(const std::string& path) const {
+  const std::string dictionary =
+      TrainDictionary(records_, level_, num_threads_);
+
+  std::unique_ptr<ZSTD_CDict, CDictDeleter> cdict;
+  if (!dictionary.empty()) {
+    cdict.reset(ZSTD_createCDict(dictionary.data(), dictionary.size(), level_));
+    if (cdict == nullptr) {
+      return false;
+    }
+  }
+
+  // Records are compressed independently, so each lands in its own slot.
+  std::vector<std::string> compressed(records_.size());
+  std::vector<const char*> errors(records_.size());
+  aur_util::ParallelFor(records_.size(), num_threads_, [&](size_t i) {
+    ZSTD_CCtx* cctx = ThreadLocalCCtx();
+    if (cctx == nullptr) {
+      errors[i] = "failed to create compression context";
+      return;
+    }
+
+    const std::string& value = records_[i].second;
+    std::string& out = compressed[i];
+    out.resize(ZSTD_compressBound(value.size()));
+    const size_t n =
+        cdict != nullptr
+            ? ZSTD_compress_usingCDict(cctx, out.data(), out.size(),
+                                       value.data(), value.size(), cdict.get())
+            : ZSTD_compressCCtx(cctx, out.data(), out.size(), value.data(),
+                                value.size(), level_);
+    if (ZSTD_isError(n)) {
+      errors[i] = ZSTD_getErrorName(n);
+      return;
+    }
+
+    out.resize(n);
+  });
+
+  PackedStorageBuilder builder;
+  for (size_t i = 0; i < records_.size(); ++i) {
+    if (errors[i] != nullptr) {
+      std::cerr << "error: failed to compress record: " << records_[i].first
+                << ": " << errors[i] << '\n';
+      return false;
+    }
+
+    builder.Add(records_[i].first, std::move(compressed[i]));
+  }
+
+  builder.AddSection(CompressedStorage::kDictionarySection, dictionary);
+
+  return builder.Write(path);
+}
+
+}  // namespace aur_storage
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "storage/packed_storage.hh"
+#include "storage/storage.hh"
+
+namespace aur_storage {
+
+// CompressedStorage serves records which were compressed with zstd by
+// CompressedStorageBuilder. Records are compressed individually against a
+// shared dictionary trained on the whole corpus, which is kept in the
+// "zstd/dictionary" section of the underlying storage. If the underlying
+// storage has no such section, its records are served as-is.
+//
+// Decompression happens in Get(), with a decompression context per thread,
+// so concurrent readers decompress in parallel. The dictionary is reloaded by
+// List() along with the underlying storage.
+class CompressedStorage : public Storage {
+ public:
+  explicit CompressedStorage(std::unique_ptr<Storage> storage);
+  ~CompressedStorage() override;
+
+  bool Get(const std::string& key, std::string* value) const override;
+  bool GetView(const std::string& key, std::string_view* value) const override;
+  bool Fingerprint(const std::string& key,
+                   uint64_t* fingerprint) const override;
+  bool GetSection(const std::string& name, std::string_view* data,
+                  std::shared_ptr<const void>* pin) const override;
+
+  std::vector<std::string> List() const override;
+
+  static constexpr char kDictionarySection[] = "zstd/dictionary";
+
+ private:
+  class Dictionary;
+
+  std::shared_ptr<const Dictionary> dictionary() const;
+  void LoadDictionary() const;
+
+  const std::unique_ptr<Storage> storage_;
+
+  mutable absl::Mutex mutex_;
+  mutable std::shared_ptr<const Dictionary> dictionary_ ABSL_GUARDED_BY(mutex_);
+};
+
+// CompressedStorageBuilder accumulates records and writes them out as a
+// packed file readable by CompressedStorage. A dictionary is trained on the
+// records when Write() is called, and the records are then compressed at
+// |level| across |num_threads| threads, where a non-positive count uses every
+// available CPU.
+class CompressedStorageBuilder {
+ public:
+  explicit CompressedStorageBuilder(int level = kDefaultLevel,
+                                    int num_threads = 0)
+      : level_(level), num_threads_(num_threads) {}
+
+  CompressedStorageBuilder(CompressedStorageBuilder&&) = default;
+  CompressedStorageBuilder& operator=(CompressedStorageBuilder&&) = default;
+
+  CompressedStorageBuilder(const CompressedStorageBuilder&) = delete;
+  CompressedStorageBuilder& operator=(const CompressedStorageBuilder&) =
+      delete;
+
+  void Add(std::string key, std::string value);
+
+  size_t size() const { return records_.size(); }
+
+  // Trains a dictionary, compresses the accumulated records and writes them
+  // to |path|. As with PackedStorageBuilder, the file is replaced atomically.
+  bool Write(const std::string& path) const;
+
+  // A moderate level, since every record is compressed on every build. Levels
+  // up to 19 shrink the database a little further at many times the cost.
+  static constexpr int kDefaultLevel = 6;
+
+ private:
+  int level_;
+  int num_threads_;
+  std::vector<std::pair<std::string, std::string>> records_;
+};
+
+}  // namespace aur_storage
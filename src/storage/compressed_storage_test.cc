@@ -0,0 +1,138 @@
+#include "storage/compressed_storage.hh"
+
+#include "absl/strings/str_cat.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "storage/packed_storage.hh"
+#include "testing/temporary_directory.hh"
+
+using aur_storage::CompressedStorage;
+using aur_storage::CompressedStorageBuilder;
+using aur_storage::PackedStorage;
+using aur_storage::PackedStorageBuilder;
+using testing::ElementsAre;
+using testing::SizeIs;
+
+namespace {
+
+class CompressedStorageTest : public testing::Test {
+ protected:
+  std::string dbpath() const {
+    return tempdir_.dirpath() / "compressed.db";
+  }
+
+  CompressedStorage OpenStorage() const {
+    return CompressedStorage(std::make_unique<PackedStorage>(dbpath()));
+  }
+
+ private:
+  aur_testing::TemporaryDirectory tempdir_;
+};
+
+TEST_F(CompressedStorageTest, RoundTrip) {
+  // Enough similar records to train a dictionary on.
+  CompressedStorageBuilder builder;
+  for (int i = 0; i < 2000; ++i) {
+    builder.Add(absl::StrCat("package", i),
+                absl::StrCat("license=GPL arch=x86_64 depends=glibc version=",
+                             i, " description=package number ", i));
+  }
+  builder.Add("empty", "");
+  ASSERT_TRUE(builder.Write(dbpath()));
+
+  auto storage = OpenStorage();
+  EXPECT_THAT(storage.List(), SizeIs(2001));
+
+  std::string value;
+  ASSERT_TRUE(storage.Get("package1234", &value));
+  EXPECT_EQ(value,
+            "license=GPL arch=x86_64 depends=glibc version=1234 "
+            "description=package number 1234");
+
+  ASSERT_TRUE(storage.Get("empty", &value));
+  EXPECT_EQ(value, "");
+
+  EXPECT_FALSE(storage.Get("notfound", &value));
+
+  // Compressed values can't be viewed in place.
+  std::string_view view;
+  EXPECT_FALSE(storage.GetView("package1234", &view));
+
+  uint64_t fingerprint;
+  EXPECT_TRUE(storage.Fingerprint("package1234", &fingerprint));
+}
+
+TEST_F(CompressedStorageTest, WithoutDictionary) {
+  // Too little data to train a dictionary on, so records are compressed on
+  // their own.
+  CompressedStorageBuilder builder;
+  builder.Add("auracle", "auracle-contents");
+  ASSERT_TRUE(builder.Write(dbpath()));
+
+  auto storage = OpenStorage();
+  EXPECT_THAT(storage.List(), ElementsAre("auracle"));
+
+  std::string value;
+  ASSERT_TRUE(storage.Get("auracle", &value));
+  EXPECT_EQ(value, "auracle-contents");
+}
+
+TEST_F(CompressedStorageTest, RejectsOversizedRecord) {
+  // A frame header claiming a terabyte of content, with no content.
+  const std::string frame(
+      "\x28\xb5\x2f\xfd"                   // magic
+      "\xe0"                               // 8-byte content size follows
+      "\x00\x00\x00\x00\x00\x01\x00\x00",  // 2^40
+      13);
+
+  PackedStorageBuilder builder;
+  builder.Add("auracle", frame);
+  builder.AddSection(CompressedStorage::kDictionarySection, "");
+  ASSERT_TRUE(builder.Write(dbpath()));
+
+  auto storage = OpenStorage();
+  std::string value;
+  EXPECT_FALSE(storage.Get("auracle", &value));
+}
+
+TEST_F(CompressedStorageTest, PassesThroughUncompressedStorage) {
+  PackedStorageBuilder builder;
+  builder.Add("auracle", "auracle-contents");
+  ASSERT_TRUE(builder.Write(dbpath()));
+
+  auto storage = OpenStorage();
+  EXPECT_THAT(storage.List(), ElementsAre("auracle"));
+
+  std::string value;
+  ASSERT_TRUE(storage.Get("auracle", &value));
+  EXPECT_EQ(value, "auracle-contents");
+
+  std::string_view view;
+  ASSERT_TRUE(storage.GetView("auracle", &view));
+  EXPECT_EQ(view, "auracle-contents");
+}
+
+TEST_F(CompressedStorageTest, ReloadsDictionaryOnList) {
+  {
+    PackedStorageBuilder builder;
+    builder.Add("auracle", "v1");
+    ASSERT_TRUE(builder.Write(dbpath()));
+  }
+
+  auto storage = OpenStorage();
+  EXPECT_THAT(storage.List(), ElementsAre("auracle"));
+
+  {
+    CompressedStorageBuilder builder;
+    builder.Add("auracle", "v2");
+    ASSERT_TRUE(builder.Write(dbpath()));
+  }
+
+  EXPECT_THAT(storage.List(), ElementsAre("auracle"));
+
+  std::string value;
+  ASSERT_TRUE(storage.Get("auracle", &value));
+  EXPECT_EQ(value, "v2");
+}
+
+}  // namespace
@@ -1,13 +1,56 @@
 #include "storage/filesystem_storage.hh"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
 #include <filesystem>
+#include <iostream>
+#include <memory>
+#include <tuple>
 
+#include "absl/hash/hash.h"
 #include "storage/file_io.hh"
+#include "storage/io_uring.hh"
 
 namespace fs = std::filesystem;
 
 namespace aur_storage {
 
+namespace {
+
+// Number of reads kept in flight by MultiGet().
+constexpr unsigned kQueueDepth = 64;
+
+// Set once a ring couldn't be created, so that no thread tries again.
+std::atomic<bool> io_uring_unavailable{false};
+
+// Each thread sets up its ring on first use and keeps it for every later
+// MultiGet(), rather than paying for a new one per call.
+thread_local std::unique_ptr<IoUring> thread_ring;
+thread_local bool thread_ring_created = false;
+
+// Returns this thread's ring, or nullptr if reads should be made
+// synchronously instead.
+IoUring* ThreadRing() {
+  if (!thread_ring_created &&
+      !io_uring_unavailable.load(std::memory_order_relaxed)) {
+    thread_ring_created = true;
+    thread_ring = IoUring::Create(kQueueDepth);
+    if (thread_ring == nullptr) {
+      io_uring_unavailable.store(true, std::memory_order_relaxed);
+    }
+  }
+
+  return thread_ring.get();
+}
+
+}  // namespace
+
 bool FilesystemStorage::Get(const std::string& key, std::string* value) const {
   // Actively reject any requests that look like filesystem traversal.
   if (key.find('/') != key.npos) {
@@ -17,6 +60,194 @@ bool FilesystemStorage::Get(const std::string& key, std::string* value) const {
   return ReadFileToString(root_ / key, value);
 }
 
+std::vector<bool> FilesystemStorage::MultiGet(
+    absl::Span<const std::string> keys,
+    std::vector<std::string>* values) const {
+  IoUring* ring = ThreadRing();
+  if (ring == nullptr) {
+    return Storage::MultiGet(keys, values);
+  }
+
+  values->assign(keys.size(), std::string());
+  std::vector<bool> found(keys.size());
+
+  // Files are opened and sized synchronously, and their contents are read
+  // through the ring into |buffers|. A read may come back short, in which case
+  // the remainder is queued again. Keys that can't be read through the ring
+  // are marked for fallback, and read with Get() once the ring is done.
+  struct Read {
+    int fd = -1;
+    size_t offset = 0;
+    bool fallback = false;
+  };
+  std::vector<Read> reads(keys.size());
+  auto buffers = std::make_unique<std::vector<std::string>>(keys.size());
+  bool ring_failed = false;
+
+  auto fall_back = [&](size_t i) {
+    if (reads[i].fd >= 0) {
+      close(reads[i].fd);
+    }
+    reads[i].fd = -1;
+    reads[i].fallback = true;
+  };
+
+  auto finish = [&](size_t i, bool success) {
+    close(reads[i].fd);
+    reads[i].fd = -1;
+    found[i] = success;
+    if (success) {
+      (*values)[i] = std::move((*buffers)[i]);
+    }
+  };
+
+  // Returns false, having marked the key for fallback, if the read can't be
+  // queued.
+  auto queue_read = [&](size_t i) {
+    std::string& buffer = (*buffers)[i];
+    if (ring_failed ||
+        !ring->PrepareRead(reads[i].fd, buffer.data() + reads[i].offset,
+                           buffer.size() - reads[i].offset, reads[i].offset,
+                           i)) {
+      fall_back(i);
+      return false;
+    }
+    return true;
+  };
+
+  size_t next = 0;
+  unsigned in_flight = 0;
+  auto on_completion = [&](uint64_t i, int result) {
+    if (result == -EINTR || result == -EAGAIN) {
+      if (!queue_read(i)) {
+        --in_flight;
+      }
+      return;
+    }
+
+    if (result == -EINVAL || result == -EOPNOTSUPP) {
+      // The kernel can't do this read through the ring.
+      fall_back(i);
+      --in_flight;
+      return;
+    }
+
+    if (result <= 0) {
+      // Either an error, or the file was truncated while we read it.
+      finish(i, false);
+      --in_flight;
+      return;
+    }
+
+    reads[i].offset += result;
+    if (reads[i].offset < (*buffers)[i].size()) {
+      if (!queue_read(i)) {
+        --in_flight;
+      }
+      return;
+    }
+
+    finish(i, true);
+    --in_flight;
+  };
+
+  while (next < keys.size() || in_flight > 0) {
+    while (in_flight < kQueueDepth && next < keys.size()) {
+      const size_t i = next++;
+
+      // Actively reject any requests that look like filesystem traversal.
+      if (keys[i].find('/') != keys[i].npos) {
+        continue;
+      }
+
+      reads[i].fd = open((root_ / keys[i]).c_str(), O_RDONLY | O_CLOEXEC);
+      if (reads[i].fd < 0) {
+        continue;
+      }
+
+      struct stat st;
+      if (fstat(reads[i].fd, &st) < 0) {
+        finish(i, false);
+        continue;
+      }
+
+      if (st.st_size == 0) {
+        finish(i, true);
+        continue;
+      }
+
+      (*buffers)[i].resize(st.st_size);
+      if (queue_read(i)) {
+        ++in_flight;
+      }
+    }
+
+    if (in_flight == 0) {
+      break;
+    }
+
+    if (!ring->Submit(1)) {
+      std::cerr << "warning: failed to submit reads, reading synchronously: "
+                << strerror(errno) << '\n';
+      ring_failed = true;
+      break;
+    }
+
+    ring->ForEachCompletion(on_completion);
+  }
+
+  if (ring_failed) {
+    // Reads that the kernel already has will still write into their buffers,
+    // so they have to be waited out. Those it never saw can be dropped.
+    in_flight -= ring->DiscardPending();
+    while (in_flight > 0 && ring->Submit(1)) {
+      ring->ForEachCompletion(on_completion);
+    }
+
+    if (in_flight > 0) {
+      // There's no telling when the kernel is done with the buffers, so
+      // leak them rather than let it write into freed memory.
+      std::cerr << "error: abandoning " << in_flight << " reads\n";
+      buffers.release();
+    }
+
+    for (size_t i = 0; i < keys.size(); ++i) {
+      if (reads[i].fd >= 0 || i >= next) {
+        fall_back(i);
+      }
+    }
+
+    // The ring may still hold completions for the abandoned reads, so it
+    // can't be reused. This thread reads synchronously from now on.
+    thread_ring.reset();
+  }
+
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if (reads[i].fallback) {
+      found[i] = Get(keys[i], &(*values)[i]);
+    }
+  }
+
+  return found;
+}
+
+bool FilesystemStorage::Fingerprint(const std::string& key,
+                                    uint64_t* fingerprint) const {
+  if (key.find('/') != key.npos) {
+    return false;
+  }
+
+  struct stat st;
+  if (stat((root_ / key).c_str(), &st) < 0) {
+    return false;
+  }
+
+  *fingerprint = absl::Hash<std::tuple<ino_t, off_t, time_t, long>>()(
+      std::make_tuple(st.st_ino, st.st_size, st.st_mtim.tv_sec,
+                      st.st_mtim.tv_nsec));
+  return true;
+}
+
 std::vector<std::string> FilesystemStorage::List() const {
   std::vector<std::string> results;
 
@@ -13,6 +13,17 @@ class FilesystemStorage : public Storage {
 
   bool Get(const std::string& key, std::string* value) const override;
 
+  // Keeps many reads in flight with io_uring when the kernel supports it, so
+  // that loading from a cold page cache isn't bound by the latency of each
+  // read. Each calling thread sets up one ring and reuses it across calls.
+  std::vector<bool> MultiGet(absl::Span<const std::string> keys,
+                             std::vector<std::string>* values) const override;
+
+  // Fingerprints are derived from file metadata (inode, size and mtime) rather
+  // than contents, so they are only as reliable as the writer's mtime updates.
+  bool Fingerprint(const std::string& key,
+                   uint64_t* fingerprint) const override;
+
   std::vector<std::string> List() const override;
 
  private:
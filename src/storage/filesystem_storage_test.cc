@@ -0,0 +1,70 @@
+#include "storage/filesystem_storage.hh"
+
+#include <filesystem>
+
+#include "absl/strings/str_cat.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "storage/file_io.hh"
+#include "testing/temporary_directory.hh"
+
+namespace fs = std::filesystem;
+
+using aur_storage::FilesystemStorage;
+using testing::ElementsAre;
+
+namespace {
+
+class FilesystemStorageTest : public testing::Test {
+ protected:
+  const fs::path& dbpath() const { return tempdir_.dirpath(); }
+
+  void Write(const std::string& key, const std::string& value) {
+    ASSERT_TRUE(aur_storage::WriteStringToFile(dbpath() / key, value));
+  }
+
+ private:
+  aur_testing::TemporaryDirectory tempdir_;
+};
+
+TEST_F(FilesystemStorageTest, Get) {
+  Write("auracle", "auracle-contents");
+
+  FilesystemStorage storage(dbpath());
+  EXPECT_THAT(storage.List(), ElementsAre("auracle"));
+
+  std::string value;
+  ASSERT_TRUE(storage.Get("auracle", &value));
+  EXPECT_EQ(value, "auracle-contents");
+
+  EXPECT_FALSE(storage.Get("notfound", &value));
+  EXPECT_FALSE(storage.Get("../auracle", &value));
+}
+
+TEST_F(FilesystemStorageTest, MultiGet) {
+  // More keys than reads kept in flight at once.
+  std::vector<std::string> keys;
+  for (int i = 0; i < 200; ++i) {
+    keys.push_back(absl::StrCat("package", i));
+    Write(keys.back(), std::string(i * 100, 'a' + i % 26));
+  }
+  keys.push_back("notfound");
+  keys.push_back("../package1");
+
+  FilesystemStorage storage(dbpath());
+
+  std::vector<std::string> values;
+  const auto found = storage.MultiGet(keys, &values);
+  ASSERT_EQ(found.size(), keys.size());
+  ASSERT_EQ(values.size(), keys.size());
+
+  for (int i = 0; i < 200; ++i) {
+    EXPECT_TRUE(found[i]) << keys[i];
+    EXPECT_EQ(values[i], std::string(i * 100, 'a' + i % 26)) << keys[i];
+  }
+
+  EXPECT_FALSE(found[200]);
+  EXPECT_FALSE(found[201]);
+}
+
+}  // namespace
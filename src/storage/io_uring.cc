@@ -0,0 +1,186 @@
+#include "storage/io_uring.hh"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace aur_storage {
+
+namespace {
+
+int io_uring_setup(unsigned entries, io_uring_params* params) {
+  return syscall(__NR_io_uring_setup, entries, params);
+}
+
+int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                   unsigned flags) {
+  return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                 nullptr, 0);
+}
+
+int io_uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args) {
+  return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+// Returns true if the ring |fd| supports |opcode|. Kernels before 5.6 can't be
+// probed, and don't support IORING_OP_READ either.
+bool SupportsOp(int fd, uint8_t opcode) {
+  constexpr unsigned kMaxOps = 256;
+  std::vector<char> buffer(sizeof(io_uring_probe) +
+                           kMaxOps * sizeof(io_uring_probe_op));
+  auto* probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+  if (io_uring_register(fd, IORING_REGISTER_PROBE, probe, kMaxOps) < 0) {
+    return false;
+  }
+
+  return opcode <= probe->last_op && opcode < probe->ops_len &&
+         (probe->ops[opcode].flags & IO_URING_OP_SUPPORTED);
+}
+
+template <typename T>
+T* At(void* base, uint32_t offset) {
+  return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+}
+
+}  // namespace
+
+// static
+std::unique_ptr<IoUring> IoUring::Create(unsigned entries) {
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+
+  std::unique_ptr<IoUring> ring(new IoUring);
+  ring->fd_ = io_uring_setup(entries, &params);
+  if (ring->fd_ < 0 || !SupportsOp(ring->fd_, IORING_OP_READ)) {
+    return nullptr;
+  }
+
+  ring->sq_ring_size_ =
+      params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+  ring->cq_ring_size_ =
+      params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+  // Newer kernels map both rings with a single mmap.
+  const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap) {
+    ring->sq_ring_size_ = ring->cq_ring_size_ =
+        std::max(ring->sq_ring_size_, ring->cq_ring_size_);
+  }
+
+  void* sq_ring =
+      mmap(nullptr, ring->sq_ring_size_, PROT_READ | PROT_WRITE,
+           MAP_SHARED | MAP_POPULATE, ring->fd_, IORING_OFF_SQ_RING);
+  if (sq_ring == MAP_FAILED) {
+    return nullptr;
+  }
+  ring->sq_ring_ = sq_ring;
+
+  if (single_mmap) {
+    ring->cq_ring_ = ring->sq_ring_;
+  } else {
+    void* cq_ring =
+        mmap(nullptr, ring->cq_ring_size_, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, ring->fd_, IORING_OFF_CQ_RING);
+    if (cq_ring == MAP_FAILED) {
+      return nullptr;
+    }
+    ring->cq_ring_ = cq_ring;
+  }
+
+  ring->sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+  void* sqes = mmap(nullptr, ring->sqes_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring->fd_, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    return nullptr;
+  }
+  ring->sqes_ = sqes;
+
+  auto& sq = ring->sq_;
+  sq.head = At<uint32_t>(ring->sq_ring_, params.sq_off.head);
+  sq.tail = At<uint32_t>(ring->sq_ring_, params.sq_off.tail);
+  sq.ring_mask = At<uint32_t>(ring->sq_ring_, params.sq_off.ring_mask);
+  sq.ring_entries = At<uint32_t>(ring->sq_ring_, params.sq_off.ring_entries);
+  sq.array = At<uint32_t>(ring->sq_ring_, params.sq_off.array);
+  sq.sqes = static_cast<io_uring_sqe*>(ring->sqes_);
+
+  auto& cq = ring->cq_;
+  cq.head = At<uint32_t>(ring->cq_ring_, params.cq_off.head);
+  cq.tail = At<uint32_t>(ring->cq_ring_, params.cq_off.tail);
+  cq.ring_mask = At<uint32_t>(ring->cq_ring_, params.cq_off.ring_mask);
+  cq.cqes = At<io_uring_cqe>(ring->cq_ring_, params.cq_off.cqes);
+
+  return ring;
+}
+
+IoUring::~IoUring() {
+  if (sqes_ != nullptr) {
+    munmap(sqes_, sqes_size_);
+  }
+  if (cq_ring_ != nullptr && cq_ring_ != sq_ring_) {
+    munmap(cq_ring_, cq_ring_size_);
+  }
+  if (sq_ring_ != nullptr) {
+    munmap(sq_ring_, sq_ring_size_);
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+bool IoUring::PrepareRead(int fd, void* buffer, unsigned size, uint64_t offset,
+                          uint64_t user_data) {
+  const uint32_t head = __atomic_load_n(sq_.head, __ATOMIC_ACQUIRE);
+  const uint32_t tail = *sq_.tail;
+  if (tail - head >= *sq_.ring_entries) {
+    return false;
+  }
+
+  const uint32_t index = tail & *sq_.ring_mask;
+  io_uring_sqe& sqe = sq_.sqes[index];
+  memset(&sqe, 0, sizeof(sqe));
+  sqe.opcode = IORING_OP_READ;
+  sqe.fd = fd;
+  sqe.addr = reinterpret_cast<uint64_t>(buffer);
+  sqe.len = size;
+  sqe.off = offset;
+  sqe.user_data = user_data;
+
+  sq_.array[index] = index;
+  __atomic_store_n(sq_.tail, tail + 1, __ATOMIC_RELEASE);
+  ++pending_;
+  return true;
+}
+
+unsigned IoUring::DiscardPending() {
+  // Without SQPOLL, the kernel only consumes submissions in io_uring_enter(),
+  // so entries past those it has consumed can be taken back.
+  const unsigned discarded = pending_;
+  __atomic_store_n(sq_.tail, *sq_.tail - discarded, __ATOMIC_RELEASE);
+  pending_ = 0;
+  return discarded;
+}
+
+bool IoUring::Submit(unsigned wait_for) {
+  for (;;) {
+    const int submitted =
+        io_uring_enter(fd_, pending_, wait_for, IORING_ENTER_GETEVENTS);
+    if (submitted >= 0) {
+      pending_ -= submitted;
+      if (pending_ == 0) {
+        return true;
+      }
+      continue;
+    }
+
+    if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+      return false;
+    }
+  }
+}
+
+}  // namespace aur_storage
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <linux/io_uring.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace aur_storage {
+
+// IoUring is a minimal wrapper around an io_uring instance, driven directly
+// through the kernel interface. It supports only what FilesystemStorage needs:
+// queueing reads, submitting them and reaping their completions. Instances are
+// not thread-safe; each thread should create its own.
+class IoUring {
+ public:
+  // Creates a ring with room for |entries| submissions. Returns nullptr if the
+  // kernel doesn't support io_uring or reads through it, or it's been
+  // disabled.
+  static std::unique_ptr<IoUring> Create(unsigned entries);
+
+  ~IoUring();
+
+  IoUring(IoUring&&) = delete;
+  IoUring& operator=(IoUring&&) = delete;
+
+  IoUring(const IoUring&) = delete;
+  IoUring& operator=(const IoUring&) = delete;
+
+  // Queues a read of |size| bytes at |offset| in |fd| into |buffer|. The
+  // completion will carry |user_data|. Returns false if the submission queue
+  // is full.
+  bool PrepareRead(int fd, void* buffer, unsigned size, uint64_t offset,
+                   uint64_t user_data);
+
+  // Submits all queued reads to the kernel and waits until at least
+  // |wait_for| completions are available. Returns false on failure, in which
+  // case some reads may remain queued.
+  bool Submit(unsigned wait_for);
+
+  // Drops the reads queued by PrepareRead() that haven't been submitted to
+  // the kernel, which will never complete. Returns how many were dropped.
+  unsigned DiscardPending();
+
+  // Invokes fn(user_data, result) for every available completion, where
+  // result is the number of bytes read or a negative errno.
+  template <typename Fn>
+  void ForEachCompletion(const Fn& fn) {
+    uint32_t head = *cq_.head;
+    const uint32_t tail = __atomic_load_n(cq_.tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+      const io_uring_cqe& cqe = cq_.cqes[head & *cq_.ring_mask];
+      fn(cqe.user_data, cqe.res);
+    }
+    __atomic_store_n(cq_.head, head, __ATOMIC_RELEASE);
+  }
+
+ private:
+  IoUring() = default;
+
+  struct SubmissionQueue {
+    uint32_t* head;
+    uint32_t* tail;
+    uint32_t* ring_mask;
+    uint32_t* ring_entries;
+    uint32_t* array;
+    io_uring_sqe* sqes;
+  };
+
+  struct CompletionQueue {
+    uint32_t* head;
+    uint32_t* tail;
+    uint32_t* ring_mask;
+    io_uring_cqe* cqes;
+  };
+
+  int fd_ = -1;
+
+  void* sq_ring_ = nullptr;
+  size_t sq_ring_size_ = 0;
+  void* cq_ring_ = nullptr;
+  size_t cq_ring_size_ = 0;
+  void* sqes_ = nullptr;
+  size_t sqes_size_ = 0;
+
+  SubmissionQueue sq_;
+  CompletionQueue cq_;
+
+  // Number of entries queued by PrepareRead() but not yet submitted.
+  unsigned pending_ = 0;
+};
+
+}  // namespace aur_storage
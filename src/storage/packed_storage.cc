@@ -0,0 +1,386 @@
+#include "storage/packed_storage.hh"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/hash/hash.h"
+#include "absl/strings/str_cat.h"
+#include "storage/file_io.hh"
+
+namespace aur_storage {
+
+namespace {
+
+constexpr char kMagic[8] = {'A', 'U', 'R', 'P', 'A', 'C', 'K', '\0'};
+constexpr uint32_t kVersion = 2;
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t count;
+
+  // Only present as of version 2.
+  uint32_t section_count;
+  uint32_t reserved;
+};
+
+static_assert(sizeof(Header) == 24);
+
+// Size of the header in version 1 files.
+constexpr size_t kHeaderSizeV1 = 16;
+
+constexpr size_t kSectionAlignment = 8;
+
+template <typename T>
+bool ReadScalar(std::string_view data, size_t offset, T* out) {
+  if (offset > data.size() || data.size() - offset < sizeof(T)) {
+    return false;
+  }
+
+  memcpy(out, data.data() + offset, sizeof(T));
+  return true;
+}
+
+// Reads a uint32 length-prefixed field at |*offset|, advancing the offset past
+// the field on success.
+bool ReadField(std::string_view data, size_t* offset, std::string_view* out) {
+  uint32_t size;
+  if (!ReadScalar(data, *offset, &size)) {
+    return false;
+  }
+  *offset += sizeof(size);
+
+  if (data.size() - *offset < size) {
+    return false;
+  }
+
+  *out = data.substr(*offset, size);
+  *offset += size;
+  return true;
+}
+
+template <typename T>
+void AppendScalar(std::string* out, T value) {
+  out->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+}  // namespace
+
+class PackedStorage::Mapping {
+ public:
+  // Maps the file at |path| and validates its contents. Returns nullptr on
+  // failure.
+  static std::unique_ptr<Mapping> Open(const std::string& path);
+
+  ~Mapping() {
+    if (addr_ != nullptr) {
+      munmap(addr_, size_);
+    }
+  }
+
+  Mapping(Mapping&&) = delete;
+  Mapping& operator=(Mapping&&) = delete;
+
+  Mapping(const Mapping&) = delete;
+  Mapping& operator=(const Mapping&) = delete;
+
+  // Returns true if |st| describes the same file that this mapping was
+  // created from.
+  bool SameFile(const struct stat& st) const {
+    return st.st_dev == st_.st_dev && st.st_ino == st_.st_ino &&
+           st.st_size == st_.st_size &&
+           st.st_mtim.tv_sec == st_.st_mtim.tv_sec &&
+           st.st_mtim.tv_nsec == st_.st_mtim.tv_nsec;
+  }
+
+  const std::vector<std::string_view>& keys() const { return keys_; }
+
+  bool Find(std::string_view key, std::string_view* value) const {
+    auto iter = records_.find(key);
+    if (iter == records_.end()) {
+      return false;
+    }
+
+    *value = iter->second;
+    return true;
+  }
+
+  bool FindSection(std::string_view name, std::string_view* data) const {
+    auto iter = sections_.find(name);
+    if (iter == sections_.end()) {
+      return false;
+    }
+
+    *data = iter->second;
+    return true;
+  }
+
+ private:
+  Mapping(void* addr, size_t size, const struct stat& st)
+      : addr_(addr), size_(size), st_(st) {}
+
+  bool Parse();
+
+  void* addr_;
+  size_t size_;
+  struct stat st_;
+
+  std::vector<std::string_view> keys_;
+  absl::flat_hash_map<std::string_view, std::string_view> records_;
+  absl::flat_hash_map<std::string_view, std::string_view> sections_;
+};
+
+// static
+std::unique_ptr<PackedStorage::Mapping> PackedStorage::Mapping::Open(
+    const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return nullptr;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size < static_cast<off_t>(kHeaderSizeV1)) {
+    close(fd);
+    return nullptr;
+  }
+
+  void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    return nullptr;
+  }
+
+  // We're about to touch every record, so ask for readahead of the whole file.
+  madvise(addr, st.st_size, MADV_WILLNEED);
+
+  std::unique_ptr<Mapping> mapping(new Mapping(addr, st.st_size, st));
+  if (!mapping->Parse()) {
+    return nullptr;
+  }
+
+  return mapping;
+}
+
+bool PackedStorage::Mapping::Parse() {
+  const std::string_view data(static_cast<const char*>(addr_), size_);
+
+  Header header{};
+  size_t header_size;
+  if (!ReadScalar(data, 0, &header.magic) ||
+      memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      !ReadScalar(data, offsetof(Header, version), &header.version)) {
+    return false;
+  }
+
+  switch (header.version) {
+    case 1:
+      header_size = kHeaderSizeV1;
+      if (!ReadScalar(data, offsetof(Header, count), &header.count)) {
+        return false;
+      }
+      break;
+    case 2:
+      header_size = sizeof(Header);
+      if (!ReadScalar(data, 0, &header)) {
+        return false;
+      }
+      break;
+    default:
+      return false;
+  }
+
+  // The offset table must fit in the file before its size is trusted for
+  // anything, so that a corrupt count can't make us allocate gigabytes.
+  const uint64_t num_entries =
+      static_cast<uint64_t>(header.count) + header.section_count;
+  if (num_entries > (data.size() - header_size) / sizeof(uint64_t)) {
+    return false;
+  }
+
+  keys_.reserve(header.count);
+  records_.reserve(header.count);
+
+  for (uint64_t i = 0; i < num_entries; ++i) {
+    uint64_t offset;
+    if (!ReadScalar(data, header_size + i * sizeof(offset), &offset) ||
+        offset > data.size()) {
+      return false;
+    }
+
+    size_t pos = offset;
+    std::string_view key, value;
+    if (!ReadField(data, &pos, &key) || !ReadField(data, &pos, &value)) {
+      return false;
+    }
+
+    if (i >= header.count) {
+      sections_.emplace(key, value);
+    } else if (records_.emplace(key, value).second) {
+      keys_.push_back(key);
+    }
+  }
+
+  return true;
+}
+
+PackedStorage::PackedStorage(std::string path) : path_(std::move(path)) {
+  mapping_ = Mapping::Open(path_);
+  if (mapping_ == nullptr) {
+    std::cerr << "error: failed to open packed storage: " << path_ << '\n';
+  }
+}
+
+PackedStorage::~PackedStorage() = default;
+
+std::shared_ptr<const PackedStorage::Mapping> PackedStorage::mapping() const {
+  absl::ReaderMutexLock l(&mutex_);
+  return mapping_;
+}
+
+bool PackedStorage::GetView(const std::string& key,
+                            std::string_view* value) const {
+  const auto mapping = this->mapping();
+  return mapping != nullptr && mapping->Find(key, value);
+}
+
+bool PackedStorage::Get(const std::string& key, std::string* value) const {
+  const auto mapping = this->mapping();
+
+  std::string_view view;
+  if (mapping == nullptr || !mapping->Find(key, &view)) {
+    return false;
+  }
+
+  value->assign(view.data(), view.size());
+  return true;
+}
+
+bool PackedStorage::Fingerprint(const std::string& key,
+                                uint64_t* fingerprint) const {
+  const auto mapping = this->mapping();
+
+  std::string_view view;
+  if (mapping == nullptr || !mapping->Find(key, &view)) {
+    return false;
+  }
+
+  *fingerprint = absl::Hash<std::string_view>()(view);
+  return true;
+}
+
+bool PackedStorage::GetSection(const std::string& name, std::string_view* data,
+                               std::shared_ptr<const void>* pin) const {
+  auto mapping = this->mapping();
+  if (mapping == nullptr || !mapping->FindSection(name, data)) {
+    return false;
+  }
+
+  *pin = std::move(mapping);
+  return true;
+}
+
+std::vector<std::string> PackedStorage::List() const {
+  absl::MutexLock l(&mutex_);
+
+  struct stat st;
+  if (stat(path_.c_str(), &st) == 0 &&
+      (mapping_ == nullptr || !mapping_->SameFile(st))) {
+    if (auto mapping = Mapping::Open(path_); mapping != nullptr) {
+      mapping_ = std::move(mapping);
+    } else {
+      std::cerr << "error: failed to remap packed storage: " << path_ << '\n';
+    }
+  }
+
+  if (mapping_ == nullptr) {
+    return {};
+  }
+
+  return std::vector<std::string>(mapping_->keys().begin(),
+                                  mapping_->keys().end());
+}
+
+void PackedStorageBuilder::Add(std::string key, std::string value) {
+  records_.emplace_back(std::move(key), std::move(value));
+}
+
+void PackedStorageBuilder::AddSection(std::string name, std::string data) {
+  sections_.emplace_back(std::move(name), std::move(data));
+}
+
+bool PackedStorageBuilder::Write(const std::string& path) const {
+  Header header{};
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.count = records_.size();
+  header.section_count = sections_.size();
+
+  // Lay out every entry up front, so that the offsets table can be written
+  // before the entries themselves. Sections are padded so that their data
+  // starts on an aligned boundary.
+  std::vector<uint64_t> offsets;
+  offsets.reserve(records_.size() + sections_.size());
+
+  uint64_t offset =
+      sizeof(header) + (records_.size() + sections_.size()) * sizeof(uint64_t);
+  auto layout = [&](const std::string& key, const std::string& value,
+                    size_t alignment) {
+    const uint64_t data_start = offset + 2 * sizeof(uint32_t) + key.size();
+    offset += (alignment - data_start % alignment) % alignment;
+    offsets.push_back(offset);
+    offset += 2 * sizeof(uint32_t) + key.size() + value.size();
+  };
+
+  for (const auto& [key, value] : records_) {
+    layout(key, value, 1);
+  }
+  for (const auto& [name, data] : sections_) {
+    layout(name, data, kSectionAlignment);
+  }
+
+  std::string contents;
+  contents.reserve(offset);
+  AppendScalar(&contents, header);
+  for (uint64_t entry_offset : offsets) {
+    AppendScalar(&contents, entry_offset);
+  }
+
+  size_t i = 0;
+  auto append = [&](const std::string& key, const std::string& value) {
+    contents.resize(offsets[i++], '\0');
+    AppendScalar(&contents, static_cast<uint32_t>(key.size()));
+    contents.append(key);
+    AppendScalar(&contents, static_cast<uint32_t>(value.size()));
+    contents.append(value);
+  };
+
+  for (const auto& [key, value] : records_) {
+    append(key, value);
+  }
+  for (const auto& [name, data] : sections_) {
+    append(name, data);
+  }
+
+  const std::string tmppath = absl::StrCat(path, ".tmp");
+  if (!WriteStringToFile(tmppath, contents)) {
+    return false;
+  }
+
+  if (rename(tmppath.c_str(), path.c_str()) < 0) {
+    unlink(tmppath.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+}  // namespace aur_storage
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "storage/storage.hh"
+
+namespace aur_storage {
+
+// PackedStorage serves records out of a single file, laid out as:
+//
+//   header:   8 byte magic, uint32 version, uint32 record count,
+//             uint32 section count, uint32 reserved
+//   offsets:  uint64 file offset of each record, then of each section
+//   records:  uint32 key size, key, uint32 value size, value
+//   sections: uint32 name size, name, uint32 data size, data
+//
+// Section data is padded to start on an 8-byte boundary so that it can be
+// used in place. All integers are in host byte order. Version 1 files, which
+// lack the section count and reserved fields, are still understood.
+//
+// The file is mapped into memory, and values are served directly from the
+// mapping. The file is remapped by List() if it has been replaced since it was
+// last mapped, so writers should always replace the file atomically (see
+// PackedStorageBuilder).
+class PackedStorage : public Storage {
+ public:
+  explicit PackedStorage(std::string path);
+  ~PackedStorage() override;
+
+  bool Get(const std::string& key, std::string* value) const override;
+  bool GetView(const std::string& key, std::string_view* value) const override;
+  bool Fingerprint(const std::string& key,
+                   uint64_t* fingerprint) const override;
+  bool GetSection(const std::string& name, std::string_view* data,
+                  std::shared_ptr<const void>* pin) const override;
+
+  std::vector<std::string> List() const override;
+
+ private:
+  class Mapping;
+
+  std::shared_ptr<const Mapping> mapping() const;
+
+  const std::string path_;
+
+  mutable absl::Mutex mutex_;
+  mutable std::shared_ptr<const Mapping> mapping_ ABSL_GUARDED_BY(mutex_);
+};
+
+// PackedStorageBuilder accumulates records and writes them out in the format
+// understood by PackedStorage. Records are written in insertion order.
+class PackedStorageBuilder {
+ public:
+  PackedStorageBuilder() {}
+
+  PackedStorageBuilder(PackedStorageBuilder&&) = default;
+  PackedStorageBuilder& operator=(PackedStorageBuilder&&) = default;
+
+  PackedStorageBuilder(const PackedStorageBuilder&) = delete;
+  PackedStorageBuilder& operator=(const PackedStorageBuilder&) = delete;
+
+  void Add(std::string key, std::string value);
+  void AddSection(std::string name, std::string data);
+
+  size_t size() const { return records_.size(); }
+
+  // Writes the accumulated records to |path|. The file is written to a
+  // temporary path and renamed into place, so readers never observe a
+  // partially written file.
+  bool Write(const std::string& path) const;
+
+ private:
+  std::vector<std::pair<std::string, std::string>> records_;
+  std::vector<std::pair<std::string, std::string>> sections_;
+};
+
+}  // namespace aur_storage
@@ -0,0 +1,162 @@
+#include "storage/packed_storage.hh"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "storage/file_io.hh"
+#include "testing/temporary_directory.hh"
+
+using aur_storage::PackedStorage;
+using aur_storage::PackedStorageBuilder;
+using testing::ElementsAre;
+using testing::IsEmpty;
+
+namespace {
+
+class PackedStorageTest : public testing::Test {
+ protected:
+  std::string dbpath() const { return tempdir_.dirpath() / "packed.db"; }
+
+ private:
+  aur_testing::TemporaryDirectory tempdir_;
+};
+
+TEST_F(PackedStorageTest, RoundTrip) {
+  PackedStorageBuilder builder;
+  builder.Add("pkgfile", "pkgfile-contents");
+  builder.Add("auracle", "auracle-contents");
+  builder.Add("empty", "");
+  ASSERT_TRUE(builder.Write(dbpath()));
+
+  PackedStorage storage(dbpath());
+  EXPECT_THAT(storage.List(), ElementsAre("pkgfile", "auracle", "empty"));
+
+  std::string value;
+  ASSERT_TRUE(storage.Get("auracle", &value));
+  EXPECT_EQ(value, "auracle-contents");
+
+  std::string_view view;
+  ASSERT_TRUE(storage.GetView("pkgfile", &view));
+  EXPECT_EQ(view, "pkgfile-contents");
+
+  ASSERT_TRUE(storage.Get("empty", &value));
+  EXPECT_EQ(value, "");
+
+  EXPECT_FALSE(storage.Get("notfound", &value));
+  EXPECT_FALSE(storage.GetView("notfound", &view));
+
+  std::vector<std::string> values;
+  EXPECT_THAT(storage.MultiGet({"auracle", "notfound", "pkgfile"}, &values),
+              ElementsAre(true, false, true));
+  EXPECT_THAT(values, ElementsAre("auracle-contents", "", "pkgfile-contents"));
+}
+
+TEST_F(PackedStorageTest, RemapsReplacedFileOnList) {
+  {
+    PackedStorageBuilder builder;
+    builder.Add("auracle", "v1");
+    ASSERT_TRUE(builder.Write(dbpath()));
+  }
+
+  PackedStorage storage(dbpath());
+  EXPECT_THAT(storage.List(), ElementsAre("auracle"));
+
+  {
+    PackedStorageBuilder builder;
+    builder.Add("auracle", "v2");
+    builder.Add("pkgfile", "v1");
+    ASSERT_TRUE(builder.Write(dbpath()));
+  }
+
+  EXPECT_THAT(storage.List(), ElementsAre("auracle", "pkgfile"));
+
+  std::string value;
+  ASSERT_TRUE(storage.Get("auracle", &value));
+  EXPECT_EQ(value, "v2");
+}
+
+TEST_F(PackedStorageTest, RejectsCorruptFile) {
+  PackedStorageBuilder builder;
+  builder.Add("auracle", "auracle-contents");
+  ASSERT_TRUE(builder.Write(dbpath()));
+
+  std::string contents;
+  ASSERT_TRUE(aur_storage::ReadFileToString(dbpath(), &contents));
+  contents.resize(contents.size() - 4);
+  ASSERT_TRUE(aur_storage::WriteStringToFile(dbpath(), contents));
+
+  PackedStorage storage(dbpath());
+  EXPECT_THAT(storage.List(), IsEmpty());
+
+  std::string value;
+  EXPECT_FALSE(storage.Get("auracle", &value));
+}
+
+TEST_F(PackedStorageTest, RejectsCountLargerThanFile) {
+  PackedStorageBuilder builder;
+  builder.Add("auracle", "auracle-contents");
+  ASSERT_TRUE(builder.Write(dbpath()));
+
+  std::string contents;
+  ASSERT_TRUE(aur_storage::ReadFileToString(dbpath(), &contents));
+  const uint32_t count = 0xffffffff;
+  contents.replace(12, sizeof(count), reinterpret_cast<const char*>(&count),
+                   sizeof(count));
+  ASSERT_TRUE(aur_storage::WriteStringToFile(dbpath(), contents));
+
+  PackedStorage storage(dbpath());
+  EXPECT_THAT(storage.List(), IsEmpty());
+}
+
+TEST_F(PackedStorageTest, Sections) {
+  PackedStorageBuilder builder;
+  builder.Add("auracle", "auracle-contents");
+  builder.AddSection("first", "first-data");
+  builder.AddSection("second", "second-data");
+  ASSERT_TRUE(builder.Write(dbpath()));
+
+  PackedStorage storage(dbpath());
+  EXPECT_THAT(storage.List(), ElementsAre("auracle"));
+
+  std::string_view data;
+  std::shared_ptr<const void> pin;
+  ASSERT_TRUE(storage.GetSection("first", &data, &pin));
+  EXPECT_EQ(data, "first-data");
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(data.data()) % 8, 0);
+  EXPECT_NE(pin, nullptr);
+
+  ASSERT_TRUE(storage.GetSection("second", &data, &pin));
+  EXPECT_EQ(data, "second-data");
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(data.data()) % 8, 0);
+
+  EXPECT_FALSE(storage.GetSection("auracle", &data, &pin));
+  EXPECT_FALSE(storage.GetSection("notfound", &data, &pin));
+}
+
+TEST_F(PackedStorageTest, ReadsVersion1) {
+  std::string contents("AURPACK\0", 8);
+  auto append = [&](auto value) {
+    contents.append(reinterpret_cast<const char*>(&value), sizeof(value));
+  };
+  append(uint32_t{1});   // version
+  append(uint32_t{1});   // count
+  append(uint64_t{24});  // offset of the only record
+  append(uint32_t{7});
+  contents.append("auracle");
+  append(uint32_t{5});
+  contents.append("value");
+  ASSERT_TRUE(aur_storage::WriteStringToFile(dbpath(), contents));
+
+  PackedStorage storage(dbpath());
+  EXPECT_THAT(storage.List(), ElementsAre("auracle"));
+
+  std::string value;
+  ASSERT_TRUE(storage.Get("auracle", &value));
+  EXPECT_EQ(value, "value");
+}
+
+TEST_F(PackedStorageTest, MissingFile) {
+  PackedStorage storage(dbpath());
+  EXPECT_THAT(storage.List(), IsEmpty());
+}
+
+}  // namespace
@@ -0,0 +1,32 @@
+#include "storage/storage.hh"
+
+#include <filesystem>
+
+#include "storage/compressed_storage.hh"
+#include "storage/filesystem_storage.hh"
+#include "storage/packed_storage.hh"
+
+namespace aur_storage {
+
+std::vector<bool> Storage::MultiGet(absl::Span<const std::string> keys,
+                                    std::vector<std::string>* values) const {
+  values->resize(keys.size());
+
+  std::vector<bool> found(keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    found[i] = Get(keys[i], &(*values)[i]);
+  }
+
+  return found;
+}
+
+std::unique_ptr<Storage> OpenStorage(const std::string& path) {
+  if (std::filesystem::is_regular_file(path)) {
+    return std::make_unique<CompressedStorage>(
+        std::make_unique<PackedStorage>(path));
+  }
+
+  return std::make_unique<FilesystemStorage>(path);
+}
+
+}  // namespace aur_storage
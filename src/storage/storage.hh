@@ -1,17 +1,62 @@
 #pragma once
 
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include "absl/types/span.h"
+
 namespace aur_storage {
 
+// Storage is a simple key/value interface over a backing store of serialized
+// packages. Implementations must be safe to read from multiple threads.
 class Storage {
  public:
   virtual ~Storage() {}
 
   virtual bool Get(const std::string& key, std::string* value) const = 0;
 
+  // Reads the values stored at each of |keys| into the corresponding element
+  // of |values|, which is resized to match. The returned vector holds true for
+  // each key that was read successfully. Implementations may overlap the
+  // reads; the default reads each key with Get() in turn.
+  virtual std::vector<bool> MultiGet(absl::Span<const std::string> keys,
+                                     std::vector<std::string>* values) const;
+
+  // Provides zero-copy access to the value stored at |key|. The view remains
+  // valid until the next call to List(). Implementations which cannot provide
+  // a stable view of their contents return false, and callers should fall
+  // back to Get().
+  virtual bool GetView(const std::string&, std::string_view*) const {
+    return false;
+  }
+
+  // Computes a fingerprint of the value stored at |key|, such that a changed
+  // value yields a different fingerprint with high probability. Fingerprints
+  // are only comparable within a single process. Implementations which cannot
+  // compute one cheaply return false.
+  virtual bool Fingerprint(const std::string&, uint64_t*) const {
+    return false;
+  }
+
+  // Provides access to a named auxiliary section stored alongside the values,
+  // such as prebuilt indexes. Section data is 8-byte aligned, and the view
+  // remains valid for as long as |pin| is held. Sections are versioned along
+  // with the values, i.e. after a call to List(), sections describe the
+  // listed values.
+  virtual bool GetSection(const std::string&, std::string_view*,
+                          std::shared_ptr<const void>*) const {
+    return false;
+  }
+
   virtual std::vector<std::string> List() const = 0;
 };
 
+// Opens the database at |path|. A directory is served as one file per package,
+// and a regular file is expected to be a packed database, which may be
+// compressed.
+std::unique_ptr<Storage> OpenStorage(const std::string& path);
+
 }  // namespace aur_storage
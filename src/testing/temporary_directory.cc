@@ -0,0 +1,28 @@
+#include "testing/temporary_directory.hh"
+
+#include <stdlib.h>
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace aur_testing {
+
+TemporaryDirectory::TemporaryDirectory() {
+  const char* tmpdir = getenv("TMPDIR");
+  if (tmpdir == nullptr) {
+    tmpdir = "/tmp";
+  }
+
+  std::string tmpdir_template =
+      std::string(tmpdir) + "/" +
+      testing::UnitTest::GetInstance()->current_test_info()->name() +
+      ".XXXXXX";
+  tempdir_ = mkdtemp(tmpdir_template.data());
+}
+
+TemporaryDirectory::~TemporaryDirectory() {
+  std::filesystem::remove_all(tempdir_);
+}
+
+}  // namespace aur_testing
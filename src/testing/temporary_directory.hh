@@ -0,0 +1,27 @@
+#pragma once
+
+#include <filesystem>
+
+namespace aur_testing {
+
+// TemporaryDirectory creates a uniquely named directory under $TMPDIR (or
+// /tmp), named after the running test, and removes it along with everything
+// in it when destroyed.
+class TemporaryDirectory {
+ public:
+  TemporaryDirectory();
+  ~TemporaryDirectory();
+
+  TemporaryDirectory(TemporaryDirectory&&) = delete;
+  TemporaryDirectory& operator=(TemporaryDirectory&&) = delete;
+
+  TemporaryDirectory(const TemporaryDirectory&) = delete;
+  TemporaryDirectory& operator=(const TemporaryDirectory&) = delete;
+
+  const std::filesystem::path& dirpath() const { return tempdir_; }
+
+ private:
+  std::filesystem::path tempdir_;
+};
+
+}  // namespace aur_testing
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace aur_util {
+
+// Returns the number of worker threads to use for a requested count of
+// |num_threads|, where a non-positive count selects the number of available
+// CPUs.
+inline int ResolveThreadCount(int num_threads) {
+  if (num_threads > 0) {
+    return num_threads;
+  }
+
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Invokes fn(i) for every i in [0, n) across up to |num_threads| threads,
+// including the calling thread. Indexes are handed out one at a time, in
+// order, to whichever thread is free, so a few expensive invocations don't
+// hold up the cheap ones queued behind them. Returns after all invocations
+// have completed. Callers are responsible for ensuring that concurrent
+// invocations of |fn| are safe, which is usually done by having each
+// invocation write only to its own slot of a presized output.
+template <typename Fn>
+void ParallelFor(size_t n, int num_threads, const Fn& fn) {
+  const size_t num_workers =
+      std::min(n, static_cast<size_t>(ResolveThreadCount(num_threads)));
+  if (num_workers <= 1) {
+    for (size_t i = 0; i < n; ++i) {
+      fn(i);
+    }
+    return;
+  }
+
+  std::atomic<size_t> next{0};
+  auto run = [&] {
+    for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < n;) {
+      fn(i);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(num_workers - 1);
+  for (size_t worker = 1; worker < num_workers; ++worker) {
+    threads.emplace_back(run);
+  }
+
+  run();
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+}  // namespace aur_util
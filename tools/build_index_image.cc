@@ -0,0 +1,23 @@
+#include <iostream>
+
+#include "service/internal/service_impl.hh"
+#include "storage/storage.hh"
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    std::cerr << "usage: " << program_invocation_short_name
+              << " dbpath outputfile\n";
+    return 42;
+  }
+
+  const auto storage = aur_storage::OpenStorage(argv[1]);
+
+  if (!aur_internal::ServiceImpl::WriteIndexImage(
+          storage.get(), argv[2], aur_internal::ServiceImpl::Options())) {
+    std::cerr << "error: failed to write index image: " << argv[2] << '\n';
+    return 1;
+  }
+
+  std::cout << "wrote index image to " << argv[2] << '\n';
+  return 0;
+}
@@ -1,17 +1,23 @@
+#include <getopt.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
 #include <filesystem>
+#include <iostream>
 #include <string_view>
+#include <vector>
 
 #include "absl/algorithm/container.h"
 #include "aur_internal.pb.h"
 #include "google/protobuf/repeated_field.h"
 #include "google/protobuf/util/json_util.h"
 #include "legacy.pb.h"
+#include "storage/compressed_storage.hh"
 #include "storage/file_io.hh"
+#include "storage/packed_storage.hh"
+#include "util/parallel.hh"
 
 namespace proto = google::protobuf;
 
@@ -51,35 +57,185 @@ aur_internal::Package LegacyToInternalPackage(
   return package;
 }
 
-}  // namespace
+// Parses an AUR RPC response, appending the packages it contains to
+// |packages|.
+bool ParseResponse(const std::string& json_string,
+                   std::vector<aur_internal::Package>* packages) {
+  aur_legacy::Response response;
+  const auto status = proto::util::JsonStringToMessage(json_string, &response);
+  if (!status.ok()) {
+    std::cerr << "JsonStringToMessage failed: " << status.message() << '\n';
+    return false;
+  }
 
-int main(int argc, char** argv) {
-  if (argc < 3) {
-    std::cerr << "usage: " << program_invocation_short_name
-              << " inputfile dbdir\n";
-    return 42;
+  packages->reserve(packages->size() + response.results_size());
+  for (const auto& result : response.results()) {
+    packages->push_back(LegacyToInternalPackage(result));
   }
 
+  return true;
+}
+
+// Converts a single response into one file per package under |dbroot|.
+int WriteDirectory(const std::string& inputfile,
+                   const std::filesystem::path& dbroot) {
   std::string json_string;
-  if (!aur_storage::ReadFileToString(argv[1], &json_string)) {
-    std::cerr << "error: failed to read file to string: " << argv[1] << '\n';
+  if (!aur_storage::ReadFileToString(inputfile, &json_string)) {
+    std::cerr << "error: failed to read file to string: " << inputfile << '\n';
     return 1;
   }
 
-  aur_legacy::Response response;
-  const auto status = proto::util::JsonStringToMessage(json_string, &response);
-  if (!status.ok()) {
-    std::cerr << "JsonStringToMessage failed: " << status.message() << '\n';
+  std::vector<aur_internal::Package> packages;
+  if (!ParseResponse(json_string, &packages)) {
     return 1;
   }
 
-  const std::filesystem::path dbroot = argv[2];
-  for (const auto& result : response.results()) {
-    if (!aur_storage::SetBinaryProto(dbroot / result.name(),
-                                     LegacyToInternalPackage(result))) {
+  for (const auto& package : packages) {
+    if (!aur_storage::SetBinaryProto(dbroot / package.name(), package)) {
       std::cerr << "failed to write result to db\n";
     }
   }
 
   return 0;
 }
+
+// Converts every response in |inputfiles| into a single packed database at
+// |outputfile|, written with |builder|, such as a PackedStorageBuilder. Each
+// file holds one response, and stdin ("-") holds one response per line.
+// Responses are parsed across |num_threads| threads.
+template <typename Builder>
+int WritePacked(const std::vector<std::string>& inputfiles,
+                const std::string& outputfile, int num_threads,
+                Builder builder) {
+  // Where each document came from, for warnings.
+  std::vector<std::string> documents, sources;
+  for (const auto& inputfile : inputfiles) {
+    if (inputfile == "-") {
+      int lineno = 0;
+      for (std::string line; std::getline(std::cin, line);) {
+        ++lineno;
+        if (!line.empty()) {
+          documents.push_back(std::move(line));
+          sources.push_back("stdin:" + std::to_string(lineno));
+        }
+      }
+      continue;
+    }
+
+    if (!aur_storage::ReadFileToString(inputfile,
+                                       &documents.emplace_back())) {
+      std::cerr << "error: failed to read file to string: " << inputfile
+                << '\n';
+      return 1;
+    }
+    sources.push_back(inputfile);
+  }
+
+  std::vector<std::vector<aur_internal::Package>> parsed(documents.size());
+  std::vector<char> ok(documents.size());
+  aur_util::ParallelFor(documents.size(), num_threads, [&](size_t i) {
+    ok[i] = ParseResponse(documents[i], &parsed[i]);
+    documents[i].clear();
+    documents[i].shrink_to_fit();
+  });
+
+  // A malformed response only costs us the packages in it.
+  for (size_t i = 0; i < ok.size(); ++i) {
+    if (!ok[i]) {
+      std::cerr << "warning: skipping malformed response: " << sources[i]
+                << '\n';
+    }
+  }
+
+  // Sort by name so that the output doesn't depend on the order of the
+  // inputs. The AUR shouldn't give us duplicates, but keep only the first if
+  // it does since the packed format can't represent them.
+  std::vector<const aur_internal::Package*> packages;
+  for (const auto& batch : parsed) {
+    for (const auto& package : batch) {
+      packages.push_back(&package);
+    }
+  }
+  absl::c_stable_sort(packages, [](const auto* a, const auto* b) {
+    return a->name() < b->name();
+  });
+
+  for (size_t i = 0; i < packages.size(); ++i) {
+    if (i > 0 && packages[i]->name() == packages[i - 1]->name()) {
+      std::cerr << "warning: skipping duplicate package: "
+                << packages[i]->name() << '\n';
+      continue;
+    }
+
+    builder.Add(packages[i]->name(), packages[i]->SerializeAsString());
+  }
+
+  if (!builder.Write(outputfile)) {
+    std::cerr << "error: failed to write packed db: " << outputfile << '\n';
+    return 1;
+  }
+
+  std::cout << "packed " << builder.size() << " packages into " << outputfile
+            << '\n';
+  return 0;
+}
+
+[[noreturn]] void usage() {
+  std::cerr << "usage: " << program_invocation_short_name
+            << " inputfile dbdir\n"
+            << "       " << program_invocation_short_name
+            << " [-j threads] [-z | -Z level] -o outputfile [inputfile...]\n";
+  exit(42);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const char* outputfile = nullptr;
+  int num_threads = 0;
+  bool compress = false;
+  int level = aur_storage::CompressedStorageBuilder::kDefaultLevel;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "j:o:zZ:")) != -1) {
+    switch (opt) {
+      case 'j':
+        num_threads = atoi(optarg);
+        break;
+      case 'o':
+        outputfile = optarg;
+        break;
+      case 'z':
+        compress = true;
+        break;
+      case 'Z':
+        compress = true;
+        level = atoi(optarg);
+        break;
+      default:
+        usage();
+    }
+  }
+
+  if (outputfile == nullptr) {
+    if (argc - optind != 2) {
+      usage();
+    }
+
+    return WriteDirectory(argv[optind], argv[optind + 1]);
+  }
+
+  std::vector<std::string> inputfiles(argv + optind, argv + argc);
+  if (inputfiles.empty()) {
+    inputfiles.push_back("-");
+  }
+
+  if (compress) {
+    return WritePacked(
+        inputfiles, outputfile, num_threads,
+        aur_storage::CompressedStorageBuilder(level, num_threads));
+  }
+
+  return WritePacked(inputfiles, outputfile, num_threads,
+                     aur_storage::PackedStorageBuilder());
+}
@@ -0,0 +1,78 @@
+#include <getopt.h>
+
+#include <iostream>
+#include <string>
+
+#include "absl/algorithm/container.h"
+#include "storage/compressed_storage.hh"
+#include "storage/filesystem_storage.hh"
+#include "storage/packed_storage.hh"
+
+namespace {
+
+template <typename Builder>
+int Pack(const aur_storage::Storage& storage, const std::string& outputfile,
+         Builder builder) {
+  std::vector<std::string> keys = storage.List();
+  absl::c_sort(keys);
+
+  for (auto& key : keys) {
+    std::string value;
+    if (!storage.Get(key, &value)) {
+      std::cerr << "error: failed to read package: " << key << '\n';
+      continue;
+    }
+
+    builder.Add(std::move(key), std::move(value));
+  }
+
+  if (!builder.Write(outputfile)) {
+    std::cerr << "error: failed to write packed db: " << outputfile << '\n';
+    return 1;
+  }
+
+  std::cout << "packed " << builder.size() << " packages into " << outputfile
+            << '\n';
+  return 0;
+}
+
+[[noreturn]] void usage() {
+  std::cerr << "usage: " << program_invocation_short_name
+            << " [-z | -Z level] dbdir outputfile\n";
+  exit(42);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  bool compress = false;
+  int level = aur_storage::CompressedStorageBuilder::kDefaultLevel;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "zZ:")) != -1) {
+    switch (opt) {
+      case 'z':
+        compress = true;
+        break;
+      case 'Z':
+        compress = true;
+        level = atoi(optarg);
+        break;
+      default:
+        usage();
+    }
+  }
+
+  if (argc - optind < 2) {
+    usage();
+  }
+
+  const aur_storage::FilesystemStorage storage(argv[optind]);
+
+  if (compress) {
+    return Pack(storage, argv[optind + 1],
+                aur_storage::CompressedStorageBuilder(level));
+  }
+
+  return Pack(storage, argv[optind + 1], aur_storage::PackedStorageBuilder());
+}